@@ -0,0 +1,47 @@
+#include <Arduino.h>
+#include <PS2Host.hpp>
+#include <PS2Mouse.hpp>
+
+// Connects a PS2Host and an emulated PS2Mouse back to back on one board and checks that they talk to each other.
+// Wire HOST_CLK_PIN to MOUSE_CLK_PIN and HOST_DATA_PIN to MOUSE_DATA_PIN, with a pull-up on each line.
+const int HOST_CLK_PIN = 25;
+const int HOST_DATA_PIN = 26;
+const int MOUSE_CLK_PIN = 17;
+const int MOUSE_DATA_PIN = 16;
+
+esp32_ps2dev::PS2Host host(HOST_CLK_PIN, HOST_DATA_PIN);
+esp32_ps2dev::PS2Mouse mouse(MOUSE_CLK_PIN, MOUSE_DATA_PIN);
+int failures = 0;
+
+void check(const char* what, bool ok) {
+  Serial.printf("%s %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok) failures++;
+}
+
+void setup() {
+  Serial.begin(115200);
+  host.begin();
+  mouse.begin();
+
+  uint8_t response[2] = {0, 0};
+  check("reset answers BAT and id 0", host.command(0xFF, response, 2) == 0 && response[0] == 0xAA && response[1] == 0x00);
+  check("get device id", host.command(0xF2, response, 1) == 0 && response[0] == 0x00);
+  check("enable data reporting", host.command(0xF4) == 0);
+
+  const esp32_ps2dev::PS2Packet expected = mouse.make_packet(10, -5, 0, true, false, false, false, false);
+  const int64_t sent_micros = esp_timer_get_time();
+  mouse.send_report(10, -5, 0, true, false, false, false, false);
+  uint8_t report[3];
+  int64_t received_micros = sent_micros;
+  bool ok = true;
+  for (int i = 0; i < 3; i++) {
+    ok = ok && host.read(&report[i], esp32_ps2dev::DEFAULT_HOST_RESPONSE_TIMEOUT_MILLIS, &received_micros) == 0 && report[i] == expected.data[i];
+  }
+  check("report received", ok);
+  Serial.printf("report took %lld us\n", received_micros - sent_micros);
+
+  check("disable data reporting", host.command(0xF5) == 0);
+  Serial.printf("%d failures\n", failures);
+}
+
+void loop() { delay(1000); }
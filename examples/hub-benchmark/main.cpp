@@ -0,0 +1,58 @@
+#include <Arduino.h>
+#include <driver/gpio.h>
+#include <PS2TimerEngine.hpp>
+
+// Sends mouse-sized packets on 1 to PORT_COUNT ports of one hub and prints the aggregate throughput.
+// No host needs to be connected, the internal pull-ups keep the idle lines high.
+const int PORT_COUNT = 8;
+const int CLK_PINS[PORT_COUNT] = {17, 18, 19, 21, 22, 23, 25, 26};
+const int DATA_PINS[PORT_COUNT] = {16, 4, 5, 13, 14, 27, 32, 33};
+const uint32_t CLK_HALF_PERIOD_MICROS = 30;
+const uint32_t BYTE_INTERVAL_MICROS = 100;
+const uint32_t MEASURE_MILLIS = 2000;
+
+esp32_ps2dev::PS2Hub hub(0);
+esp32_ps2dev::PS2TimerEngine* engines[PORT_COUNT];
+volatile int active_ports = 0;
+volatile uint32_t bytes_sent[PORT_COUNT];
+
+void send_packets(void* arg) {
+  const int port = (intptr_t)arg;
+  const uint8_t packet[3] = {0x08, 0x01, 0x01};
+  for (;;) {
+    if (port >= active_ports) {
+      delay(1);
+      continue;
+    }
+    if (engines[port]->transmit(packet, sizeof(packet), CLK_HALF_PERIOD_MICROS, BYTE_INTERVAL_MICROS) == 0) {
+      bytes_sent[port] += sizeof(packet);
+    }
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  hub.configure(CLK_HALF_PERIOD_MICROS);
+  for (int i = 0; i < PORT_COUNT; i++) {
+    engines[i] = new esp32_ps2dev::PS2TimerEngine(hub);
+    engines[i]->configure(CLK_HALF_PERIOD_MICROS, BYTE_INTERVAL_MICROS);
+    engines[i]->begin(CLK_PINS[i], DATA_PINS[i]);
+    gpio_pullup_en((gpio_num_t)CLK_PINS[i]);
+    gpio_pullup_en((gpio_num_t)DATA_PINS[i]);
+    xTaskCreateUniversal(send_packets, "send_packets", 2048, (void*)(intptr_t)i, 5, nullptr, APP_CPU_NUM);
+  }
+}
+
+void loop() {
+  for (int ports = 1; ports <= PORT_COUNT; ports++) {
+    for (int i = 0; i < PORT_COUNT; i++) bytes_sent[i] = 0;
+    active_ports = ports;
+    delay(MEASURE_MILLIS);
+    active_ports = 0;
+    delay(10);
+    uint32_t total = 0;
+    for (int i = 0; i < ports; i++) total += bytes_sent[i];
+    Serial.printf("%d ports: %u bytes/s, %u bytes/s per port\n", ports, total * 1000 / MEASURE_MILLIS, total * 1000 / MEASURE_MILLIS / ports);
+  }
+  delay(10000);
+}
@@ -0,0 +1,194 @@
+#ifndef DF79BF10_602B_434B_BE11_0C63E834ECF7
+#define DF79BF10_602B_434B_BE11_0C63E834ECF7
+
+#include <hal/cpu_hal.h>
+
+#include "Arduino.h"
+#include "PS2Frame.hpp"
+#include "PS2Gpio.hpp"
+
+namespace esp32_ps2dev {
+
+// Bit timing based on the CPU cycle counter.
+// Every edge is scheduled at an absolute deadline from the start of the frame, so the time spent on
+// pin operations and loop overhead does not add up, and the clock period does not depend on the CPU frequency.
+class PS2Timing {
+ public:
+  // Reads the current CPU frequency. Call it outside of critical sections.
+  explicit PS2Timing(uint32_t clk_half_period_micros) {
+    _cycles_per_micro = getCpuFrequencyMhz();
+    _half_period_cycles = clk_half_period_micros * _cycles_per_micro;
+    _quarter_period_cycles = _half_period_cycles / 2;
+  }
+
+  inline void start() { _origin = cpu_hal_get_cycle_count(); }
+  inline uint32_t elapsed() { return cpu_hal_get_cycle_count() - _origin; }
+  inline void wait_until(uint32_t deadline_cycles) {
+    while (elapsed() < deadline_cycles) {
+    }
+  }
+
+  // Shifts the remaining deadlines when the frame is resumed after `deadline`, so an interrupt served between
+  // two bits stretches the clock high time instead of shortening the following bits.
+  inline void resume_at(uint32_t deadline_cycles) {
+    const uint32_t now = elapsed();
+    if (now > deadline_cycles) _origin += now - deadline_cycles;
+  }
+
+  inline uint32_t half_period() const { return _half_period_cycles; }
+  inline uint32_t quarter_period() const { return _quarter_period_cycles; }
+  inline uint32_t period() const { return 2 * _half_period_cycles; }
+
+  // Records the falling edges of CLK to measure the clock period actually put on the wire.
+  inline void mark_falling_edge(uint8_t index) {
+    if (index == 0) {
+      _first_falling_edge = elapsed();
+    } else {
+      _last_falling_edge = elapsed();
+      _last_falling_edge_index = index;
+    }
+  }
+
+  // Average clock period between the first and the last falling edge of the last frame, or 0 if unknown.
+  uint32_t achieved_period_nanos() const {
+    if (_last_falling_edge_index == 0 || _cycles_per_micro == 0) return 0;
+    const uint32_t cycles = (_last_falling_edge - _first_falling_edge) / _last_falling_edge_index;
+    return cycles * 1000 / _cycles_per_micro;
+  }
+
+ protected:
+  uint32_t _cycles_per_micro;
+  uint32_t _half_period_cycles;
+  uint32_t _quarter_period_cycles;
+  uint32_t _origin = 0;
+  uint32_t _first_falling_edge = 0;
+  uint32_t _last_falling_edge = 0;
+  uint8_t _last_falling_edge_index = 0;
+};
+
+// Critical section of a port around the frame loops, which masks the interrupts of the core at most
+// `max_masked_micros` at a time, give or take the few cycles of the loop between two bits.
+// The frame loops hold it before each bit for one clock period. It is left first when that period would exceed
+// the bound, so interrupts are served between two bits, and not entered when the period alone exceeds it:
+// with a bound below one clock period interrupts are never masked, with MASKED_MICROS_UNBOUNDED the whole frame is.
+// It is released between the bytes of a packet.
+const uint32_t MASKED_MICROS_UNBOUNDED = UINT32_MAX;
+
+class PS2CriticalSection {
+ public:
+  // Reads the current CPU frequency. Call it outside of critical sections.
+  PS2CriticalSection(portMUX_TYPE* mux, uint32_t max_masked_micros) : _mux(mux) {
+    const uint32_t cycles_per_micro = getCpuFrequencyMhz();
+    _max_masked_cycles = (max_masked_micros >= UINT32_MAX / cycles_per_micro) ? UINT32_MAX : max_masked_micros * cycles_per_micro;
+  }
+  ~PS2CriticalSection() { release(); }
+
+  // Holds the section for the next `cycles`.
+  inline void hold(uint32_t cycles) {
+    if (_max_masked_cycles != UINT32_MAX) {
+      if (cycles > _max_masked_cycles) {
+        release();
+        return;
+      }
+      if (_held && cpu_hal_get_cycle_count() - _entered_at > _max_masked_cycles - cycles) release();
+    }
+    if (_held) return;
+    taskENTER_CRITICAL(_mux);
+    _held = true;
+    _entered_at = cpu_hal_get_cycle_count();
+  }
+  inline void release() {
+    if (!_held) return;
+    _held = false;
+    taskEXIT_CRITICAL(_mux);
+  }
+
+ protected:
+  portMUX_TYPE* _mux;
+  uint32_t _max_masked_cycles;
+  uint32_t _entered_at = 0;
+  bool _held = false;
+};
+
+// Frame loops shared by PS2dev and PS2devT. `Pins` is PS2Pins or PS2PinsT.
+
+// Clocks out an 11-bit frame, LSB first, holding `cs` bit by bit.
+// Device sends on falling clock, DATA is changed a quarter period before CLK falls.
+// Returns 0 on success, -3 if the host pulled CLK low between bits. The frame is then aborted right away,
+// as the host may already be requesting to send, and the host discards the incomplete byte.
+template <class Pins>
+inline int ps2_write_frame(Pins& pins, uint16_t frame, PS2Timing& timing, PS2CriticalSection& cs) {
+  timing.start();
+  for (uint8_t i = 0; i < FRAME_BITS; i++) {
+    const uint32_t bit_start = i * timing.period();
+    timing.wait_until(bit_start);
+    cs.hold(timing.period());
+    timing.resume_at(bit_start);
+    if (frame & 0x01) {
+      pins.data_release();
+    } else {
+      pins.data_low();
+    }
+    timing.wait_until(bit_start + timing.quarter_period());
+    // CLK has been released for at least a quarter period here, so a low level means the host holds it
+    if (!pins.clk_read()) {
+      pins.data_release();
+      return -3;
+    }
+    pins.clk_low();
+    timing.mark_falling_edge(i);
+    timing.wait_until(bit_start + timing.quarter_period() + timing.half_period());
+    pins.clk_release();
+    frame = frame >> 1;
+  }
+  timing.wait_until(FRAME_BITS * timing.period());
+  return 0;
+}
+
+// Clocks in a host-to-device frame and answers with the ACK bit, holding `cs` bit by bit.
+// Must be called after the host requested to send. Returns 0 on success, -2 on parity error.
+//
+// The device generates 11 clock pulses. The host puts a bit on DATA while CLK is low and the device samples it
+// before the next pulse: the 8 data bits and the parity bit are sampled before pulses 2 to 10,
+// the host puts the stop bit during pulse 10, and the device pulls DATA low during pulse 11 as the ACK bit.
+template <class Pins>
+inline int ps2_read_frame(Pins& pins, uint8_t* value, PS2Timing& timing, PS2CriticalSection& cs) {
+  const uint8_t PULSES = FRAME_BITS;
+
+  unsigned int data = 0x00;
+  unsigned char calculated_parity = 1;
+  unsigned char received_parity = 0;
+
+  timing.start();
+  for (uint8_t i = 0; i < PULSES; i++) {
+    const uint32_t bit_start = i * timing.period();
+    timing.wait_until(bit_start);
+    cs.hold(timing.period());
+    timing.resume_at(bit_start);
+    if (i >= 1 && i <= 8) {
+      if (pins.data_read()) {
+        data = data | (1 << (i - 1));
+        calculated_parity = calculated_parity ^ 1;
+      }
+    } else if (i == 9) {
+      received_parity = pins.data_read() ? 1 : 0;
+    } else if (i == PULSES - 1) {
+      pins.data_low();
+    }
+    timing.wait_until(bit_start + timing.quarter_period());
+    pins.clk_low();
+    timing.mark_falling_edge(i);
+    timing.wait_until(bit_start + timing.quarter_period() + timing.half_period());
+    pins.clk_release();
+  }
+  timing.wait_until(PULSES * timing.period());
+  pins.data_release();
+
+  *value = data & 0x00FF;
+
+  return (received_parity == calculated_parity) ? 0 : -2;
+}
+
+}  // namespace esp32_ps2dev
+
+#endif /* DF79BF10_602B_434B_BE11_0C63E834ECF7 */
@@ -2,9 +2,15 @@
 
 namespace esp32_ps2dev {
 
+// Commands shared by keyboards and mice which mark the start and the end of host initialization.
+const uint8_t HOST_CMD_RESET = 0xFF;
+const uint8_t HOST_CMD_RESEND = 0xFE;
+const uint8_t HOST_CMD_ENABLE_DATA_REPORTING = 0xF4;
+
 PS2dev::PS2dev(int clk, int data) {
   _ps2clk = clk;
   _ps2data = data;
+  _packet_queue.set_drop_callback([this](const PS2Packet& packet) { _complete_packet(packet, PS2PacketStatus::DROPPED, 0); });
 }
 
 void PS2dev::config(UBaseType_t task_priority, BaseType_t task_core) {
@@ -17,174 +23,365 @@ void PS2dev::config(UBaseType_t task_priority, BaseType_t task_core) {
   _config_task_core = task_core;
 }
 
-void PS2dev::begin() {
-  gohi(_ps2clk);
-  gohi(_ps2data);
-  _mutex_bus = xSemaphoreCreateMutex();
-  _queue_packet = xQueueCreate(PACKET_QUEUE_LENGTH, sizeof(PS2Packet*));
-  xTaskCreateUniversal(_taskfn_process_host_request, "process_host_request", 4096, this, _config_task_priority, &_task_process_host_request,
-                       _config_task_core);
-  xTaskCreateUniversal(_taskfn_send_packet, "send_packet", 4096, this, _config_task_priority - 1, &_task_send_packet, _config_task_core);
+// Stack size in bytes of each task created by begin(), and by PS2Mouse::begin(). Must be called before begin().
+void PS2dev::set_task_stack_size(uint32_t stack_size) { _config_task_stack_size = stack_size; }
+
+// Runs the port in a single task instead of one task per role. The task waits for host requests, queued packets
+// and the periodic work of the device at once. Its stack is `stack` if given, or allocated once by begin().
+// Must be called before begin().
+void PS2dev::set_merged_task(StackType_t* stack, uint32_t stack_size) {
+  _config_merged_task = true;
+  _config_merged_task_stack = stack;
+  _config_merged_task_stack_size = stack_size;
+}
+
+// Lets the chip sleep while the bus is quiet: the tasks of the port wake on host requests, queued packets and input
+// instead of polling, and DATA going low wakes the chip from light sleep if the pin allows it. Light sleep itself is
+// enabled by the application with esp_pm_configure(). Must be called before begin().
+void PS2dev::set_idle_mode(bool enabled) { _config_idle_mode = enabled; }
+
+// Minimum free stack in bytes the task has ever had, to size the stacks. Both are the same task when merged.
+UBaseType_t PS2dev::get_host_task_stack_high_water_mark() {
+  return (_task_process_host_request != nullptr) ? uxTaskGetStackHighWaterMark(_task_process_host_request) : 0;
+}
+UBaseType_t PS2dev::get_send_task_stack_high_water_mark() {
+  return (_task_send_packet != nullptr) ? uxTaskGetStackHighWaterMark(_task_send_packet) : 0;
 }
 
-void PS2dev::gohi(int pin) {
-  digitalWrite(pin, HIGH);
-  pinMode(pin, INPUT);
+// Same core selection as xTaskCreateUniversal().
+static TaskHandle_t create_static_task(TaskFunction_t fn, const char* name, uint32_t stack_size, void* arg, UBaseType_t priority,
+                                       StackType_t* stack, StaticTask_t* buffer, BaseType_t core) {
+#ifndef CONFIG_FREERTOS_UNICORE
+  if (core >= 0 && core < portNUM_PROCESSORS) {
+    return xTaskCreateStaticPinnedToCore(fn, name, stack_size, arg, priority, stack, buffer, core);
+  }
+#endif
+  return xTaskCreateStatic(fn, name, stack_size, arg, priority, stack, buffer);
 }
 
-void PS2dev::golo(int pin) {
-  pinMode(pin, OUTPUT_OPEN_DRAIN);
-  digitalWrite(pin, LOW);
+void PS2dev::begin() {
+  ps2_gpio_init(_ps2clk);
+  ps2_gpio_init(_ps2data);
+  _mutex_bus = xSemaphoreCreateMutexStatic(&_mutex_bus_buffer);
+  _pm_lock.begin("ps2dev");
+  if (_config_idle_mode && ps2_enable_light_sleep_wakeup(_ps2data) != 0) {
+    PS2DEV_LOGW("PS2dev::begin: DATA pin cannot wake the chip from light sleep");
+  }
+  if (_timer_engine != nullptr) {
+    _timer_engine->configure(_config_clk_half_period_micros, _config_byte_interval_micros);
+    _transmitter = _timer_engine;
+  }
+  if (_transmitter != nullptr && _transmitter->begin(_ps2clk, _ps2data) != 0) {
+    PS2DEV_LOGE("PS2dev::begin: transmitter failed to begin, falling back to bit-banging");
+    _transmitter = nullptr;
+    _timer_engine = nullptr;
+  }
+  if (_config_packet_queue_storage != nullptr) {
+    _packet_queue.begin(_config_packet_queue_storage, _config_packet_queue_length);
+  } else {
+    _packet_queue.begin(_config_packet_queue_length);
+  }
+  _response_queue.begin(_response_queue_storage, RESPONSE_QUEUE_LENGTH);
+  if (_config_merged_task) {
+    if (_config_merged_task_stack == nullptr) {
+      _config_merged_task_stack = new StackType_t[_config_merged_task_stack_size];
+    }
+    _task_process_host_request = create_static_task(_taskfn_port, "ps2_port", _config_merged_task_stack_size, this, _config_task_priority,
+                                                    _config_merged_task_stack, &_merged_task_buffer, _config_task_core);
+    _task_send_packet = _task_process_host_request;
+  } else {
+    xTaskCreateUniversal(_taskfn_process_host_request, "process_host_request", _config_task_stack_size, this, _config_task_priority,
+                         &_task_process_host_request, _config_task_core);
+    xTaskCreateUniversal(_taskfn_send_packet, "send_packet", _config_task_stack_size, this, _config_task_priority - 1, &_task_send_packet,
+                         _config_task_core);
+  }
+  if (_timer_engine != nullptr) {
+    _timer_engine->set_rx_notify_task(_task_process_host_request);
+  }
+  attachInterruptArg(_ps2data, _isr_host_request_to_send, this, FALLING);
+  attachInterruptArg(_ps2clk, _isr_host_request_to_send, this, RISING);
 }
 
+void PS2dev::gohi(int pin) { ps2_gpio_release(pin); }
+void PS2dev::golo(int pin) { ps2_gpio_low(pin); }
+
 void PS2dev::ack() {
   delayMicroseconds(_config_byte_interval_micros);
   write(0xFA);
   delayMicroseconds(_config_byte_interval_micros);
 }
 
+// Returns 0 on success, -1 if the bus is not idle, and -3 if the host pulled CLK low in the middle of the frame.
 int PS2dev::write(unsigned char data) {
-  const auto clk_half_period_micros = _config_clk_half_period_micros;
-  const auto clk_quater_period_micros = _config_clk_half_period_micros / 2;
-
-  unsigned char i;
-  unsigned char parity = 1;
+  _begin_clocking();
+  const int64_t started_micros = esp_timer_get_time();
+  const int ret = _write_byte(data);
+  _end_clocking();
+  _record_write(ret, &data, 1, (ret == 0) ? 1 : 0, started_micros);
+  return ret;
+}
 
+int PS2dev::_write_byte(unsigned char data) {
+  if (_timer_engine != nullptr) {
+    return _timer_engine->transmit(&data, 1, _config_clk_half_period_micros, _config_byte_interval_micros);
+  }
   if (get_bus_state() != BusState::IDLE) {
     return -1;
   }
 
-  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
-  taskENTER_CRITICAL(&mux);
+  PS2Timing timing(_config_clk_half_period_micros);
+  PS2CriticalSection cs(&_mux, _config_max_masked_micros);
+  const int ret = _write_frame(FRAME_TABLE[data], timing, cs);
+  cs.release();
+  _achieved_clk_period_nanos = timing.achieved_period_nanos();
 
-  golo(_ps2data);
-  delayMicroseconds(clk_quater_period_micros);
-  // device sends on falling clock
-  golo(_ps2clk);  // start bit
-  delayMicroseconds(clk_half_period_micros);
-  gohi(_ps2clk);
-  delayMicroseconds(clk_quater_period_micros);
+  return ret;
+}
 
-  for (i = 0; i < 8; i++) {
-    if (data & 0x01) {
-      gohi(_ps2data);
-    } else {
-      golo(_ps2data);
-    }
-    delayMicroseconds(clk_quater_period_micros);
-    golo(_ps2clk);
-    delayMicroseconds(clk_half_period_micros);
-    gohi(_ps2clk);
-    delayMicroseconds(clk_quater_period_micros);
+int PS2dev::write_packet(const PS2Packet& packet) { return write_packet(packet, _config_byte_interval_micros); }
+
+// Sends all bytes of a packet without yielding, so the gap between bytes does not depend on scheduling.
+// Returns 0 on success, -1 if the bus is not idle before the first byte,
+// and -3 if the host inhibited the bus in the middle of the packet.
+int PS2dev::write_packet(const PS2Packet& packet, uint32_t byte_gap_micros) {
+  _begin_clocking();
+  const int64_t started_micros = esp_timer_get_time();
+  size_t sent = 0;
+  const int ret = _write_packet(packet, byte_gap_micros, &sent);
+  _end_clocking();
+  _record_write(ret, packet.data, packet.len, sent, started_micros);
+  return ret;
+}
 
-    parity = parity ^ (data & 0x01);
-    data = data >> 1;
+// `sent` receives the number of bytes sent before an error. The timer engine reports whole packets only.
+int PS2dev::_write_packet(const PS2Packet& packet, uint32_t byte_gap_micros, size_t* sent) {
+  if (_timer_engine != nullptr) {
+    const int ret = _timer_engine->transmit(packet.data, packet.len, _config_clk_half_period_micros, byte_gap_micros);
+    *sent = (ret == 0) ? packet.len : 0;
+    return ret;
   }
-  // parity bit
-  if (parity) {
-    gohi(_ps2data);
-  } else {
-    golo(_ps2data);
+  if (get_bus_state() != BusState::IDLE) {
+    return -1;
   }
-  delayMicroseconds(clk_quater_period_micros);
-  golo(_ps2clk);
-  delayMicroseconds(clk_half_period_micros);
-  gohi(_ps2clk);
-  delayMicroseconds(clk_quater_period_micros);
 
-  // stop bit
-  gohi(_ps2data);
-  delayMicroseconds(clk_quater_period_micros);
-  golo(_ps2clk);
-  delayMicroseconds(clk_half_period_micros);
-  gohi(_ps2clk);
-  delayMicroseconds(clk_quater_period_micros);
+  int ret = 0;
+  PS2Timing timing(_config_clk_half_period_micros);
+  PS2CriticalSection cs(&_mux, _config_max_masked_micros);
+  for (uint8_t i = 0; i < packet.len; i++) {
+    if (i > 0) {
+      delayMicroseconds(byte_gap_micros);
+      if (get_bus_state() != BusState::IDLE) {
+        ret = -3;
+        break;
+      }
+    }
+    ret = _write_frame(FRAME_TABLE[packet.data[i]], timing, cs);
+    // interrupts are served in the gap between bytes
+    cs.release();
+    if (ret != 0) break;
+    *sent = i + 1;
+  }
+  cs.release();
+  _achieved_clk_period_nanos = timing.achieved_period_nanos();
 
-  taskEXIT_CRITICAL(&mux);
+  return ret;
+}
 
-  return 0;
+// Frames clocked by this port are bracketed by these, see _isr_host_request_to_send().
+// The CPU frequency is locked first, as PS2Timing reads it.
+void PS2dev::_begin_clocking() {
+  _pm_lock.acquire();
+  _clocking = true;
 }
 
-int PS2dev::read(unsigned char* value, uint64_t timeout_ms) {
-  const auto clk_half_period_micros = _config_clk_half_period_micros;
-  const auto clk_quater_period_micros = _config_clk_half_period_micros / 2;
+// A request to send the host made while the interrupt was ignoring the bus is passed on to the task here.
+void PS2dev::_end_clocking() {
+  _clocking = false;
+  _pm_lock.release();
+  if (_timer_engine == nullptr && get_bus_state() == BusState::HOST_REQUEST_TO_SEND && _task_process_host_request != nullptr) {
+    xTaskNotifyGive(_task_process_host_request);
+  }
+  _notify_bus_waiter();
+}
 
-  unsigned int data = 0x00;
-  unsigned int bit = 0x01;
+// Blocks the calling task until the bus may have changed. The caller sets _task_waiting_for_bus before it
+// checks the bus, so an edge in between leaves the notification pending instead of being missed.
+void PS2dev::_wait_for_bus(uint32_t timeout_millis) {
+  ulTaskNotifyTake(pdTRUE, (timeout_millis == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_millis));
+}
 
-  unsigned char calculated_parity = 1;
-  unsigned char received_parity = 0;
+void PS2dev::_notify_bus_waiter() {
+  TaskHandle_t waiting = _task_waiting_for_bus;
+  if (waiting != nullptr) xTaskNotifyGive(waiting);
+}
 
-  // wait for data line to go low and clock line to go high (or timeout)
-  unsigned long waiting_since = millis();
-  while (get_bus_state() != BusState::HOST_REQUEST_TO_SEND) {
-    if ((millis() - waiting_since) > timeout_ms) return -1;
-    delay(1);
+// Updates the statistics and the trace after `sent` of `len` bytes were sent to the host.
+// The byte that failed is traced as an INHIBIT entry with the error.
+void PS2dev::_record_write(int ret, const uint8_t* data, size_t len, size_t sent, int64_t started_micros) {
+  _stats.add(&PS2Stats::bytes_sent, sent);
+  if (ret == 0) {
+    if (len > 0) _stats.add_byte_time((esp_timer_get_time() - started_micros) / len);
+  } else if (ret == -1) {
+    _stats.add(&PS2Stats::write_failures);
+  } else if (ret == -3) {
+    _stats.add(&PS2Stats::inhibits);
   }
+  if (_trace != nullptr && len > 0) {
+    for (size_t i = 0; i < sent; i++) _trace->record(PS2TraceEvent::DEVICE_TO_HOST, data[i]);
+    if (ret != 0) _trace->record(PS2TraceEvent::INHIBIT, data[(sent < len) ? sent : len - 1], ret);
+  }
+}
 
-  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
-  taskENTER_CRITICAL(&mux);
-
-  delayMicroseconds(clk_quater_period_micros);
-  golo(_ps2clk);
-  delayMicroseconds(clk_half_period_micros);
-  gohi(_ps2clk);
-  delayMicroseconds(clk_quater_period_micros);
+// Updates the statistics and the trace after a byte was received from the host.
+void PS2dev::_record_read(int ret, uint8_t value) {
+  if (ret == -2) _stats.add(&PS2Stats::parity_errors);
+  if (_trace != nullptr && ret != -1) _trace->record(PS2TraceEvent::HOST_TO_DEVICE, value, ret);
+}
 
-  while (bit < 0x0100) {
-    if (digitalRead(_ps2data) == HIGH) {
-      data = data | bit;
-      calculated_parity = calculated_parity ^ 1;
-    } else {
-      calculated_parity = calculated_parity ^ 0;
+// Sends one queued packet, responses to host commands first. Returns false if both queues are empty.
+bool PS2dev::_send_next_packet() {
+  PS2Packet packet;
+  if (_response_queue.pop(&packet, 0)) {
+    _send_queued_packet(packet);
+    _response_latency_micros = esp_timer_get_time() - _response_command_micros;
+    if (_response_latency_micros > _max_response_latency_micros) {
+      _max_response_latency_micros = _response_latency_micros;
     }
-
-    bit = bit << 1;
-
-    delayMicroseconds(clk_quater_period_micros);
-    golo(_ps2clk);
-    delayMicroseconds(clk_half_period_micros);
-    gohi(_ps2clk);
-    delayMicroseconds(clk_quater_period_micros);
+    return true;
+  }
+  if (_packet_queue.pop(&packet, 0)) {
+    _send_queued_packet(packet);
+    return true;
   }
-  // we do the delay at the end of the loop, so at this point we have
-  // already done the delay for the parity bit
+  return false;
+}
+
+// Sends a packet taken from the queue. While the host is talking the packet is held back, and if the host
+// inhibits the bus in the middle of the packet, the whole packet is sent again once the host has finished.
+// The packet is dropped after it was interrupted more than the configured number of retries.
+void PS2dev::_send_queued_packet(const PS2Packet& packet) {
+  uint8_t retries = 0;
+  int64_t started_micros = 0;
+  const uint32_t host_returns = _host_returns;
+  while (true) {
+    _task_waiting_for_bus = xTaskGetCurrentTaskHandle();
+    while (get_bus_state() != BusState::IDLE) {
+      // no other task serves the host in the merged model
+      if (_config_merged_task) _process_host_request();
+      // a host giving up its request releases DATA without an edge the interrupt watches, hence the bound
+      _wait_for_bus(_host_check_interval_millis());
+    }
+    _task_waiting_for_bus = nullptr;
+    if (_host_returns != host_returns && _is_stale(packet)) {
+      _packet_drop_count++;
+      _complete_packet(packet, PS2PacketStatus::DROPPED, started_micros);
+      return;
+    }
+    int ret = -1;
+    xSemaphoreTake(_mutex_bus, portMAX_DELAY);
+    if (get_bus_state() == BusState::IDLE) {
+      delayMicroseconds(_config_byte_interval_micros);
+      if (started_micros == 0) {
+        started_micros = esp_timer_get_time();
+        _stats.add_queue_wait(started_micros - packet.enqueued_micros);
+      }
+      if (_transmitter != nullptr) {
+        _begin_clocking();
+        const int64_t transmit_started_micros = esp_timer_get_time();
+        ret = _transmitter->transmit(packet.data, packet.len, _config_clk_half_period_micros, _config_byte_interval_micros);
+        _end_clocking();
+        // transmitters report whole packets only
+        _record_write(ret, packet.data, packet.len, (ret == 0) ? packet.len : 0, transmit_started_micros);
+      } else {
+        ret = write_packet(packet);
+      }
+      delayMicroseconds(_config_byte_interval_micros);
+      if (ret == 0 && _calibrator.active()) {
+        _on_calibration_step(_calibrator.on_packet_sent());
+      }
+    }
+    xSemaphoreGive(_mutex_bus);
 
-  // parity bit
-  if (digitalRead(_ps2data) == HIGH) {
-    received_parity = 1;
+    if (ret == 0) {
+      _stats.add(&PS2Stats::packets_sent);
+      _complete_packet(packet, PS2PacketStatus::SENT, started_micros);
+      return;
+    }
+    if (ret == -3) {
+      if (retries >= _config_packet_max_retries) {
+        _packet_drop_count++;
+        PS2DEV_LOGW("PS2dev::_send_queued_packet: packet dropped after retries");
+        _complete_packet(packet, PS2PacketStatus::ABORTED, started_micros);
+        return;
+      }
+      retries++;
+      _packet_retry_count++;
+    }
   }
+}
 
-  // stop bit
-  delayMicroseconds(clk_quater_period_micros);
-  golo(_ps2clk);
-  delayMicroseconds(clk_half_period_micros);
-  gohi(_ps2clk);
-  delayMicroseconds(clk_quater_period_micros);
+int PS2dev::_write_frame(uint16_t frame, PS2Timing& timing, PS2CriticalSection& cs) {
+  PS2Pins pins(_ps2clk, _ps2data);
+  return ps2_write_frame(pins, frame, timing, cs);
+}
 
-  delayMicroseconds(clk_quater_period_micros);
-  golo(_ps2data);
-  golo(_ps2clk);
-  delayMicroseconds(clk_half_period_micros);
-  gohi(_ps2clk);
-  delayMicroseconds(clk_quater_period_micros);
-  gohi(_ps2data);
+int PS2dev::_read_frame(uint8_t* value, PS2Timing& timing, PS2CriticalSection& cs) {
+  PS2Pins pins(_ps2clk, _ps2data);
+  return ps2_read_frame(pins, value, timing, cs);
+}
 
-  taskEXIT_CRITICAL(&mux);
+int PS2dev::read(unsigned char* value, uint64_t timeout_ms) {
+  if (_timer_engine != nullptr) {
+    const int ret = _timer_engine->receive(value, timeout_ms + TIMER_ENGINE_FRAME_MILLIS);
+    _record_read(ret, *value);
+    return ret;
+  }
 
-  *value = data & 0x00FF;
+  // wait for data line to go low and clock line to go high (or timeout)
+  unsigned long waiting_since = millis();
+  _task_waiting_for_bus = xTaskGetCurrentTaskHandle();
+  while (get_bus_state() != BusState::HOST_REQUEST_TO_SEND) {
+    const unsigned long waited_millis = millis() - waiting_since;
+    if (waited_millis > timeout_ms) {
+      _task_waiting_for_bus = nullptr;
+      return -1;
+    }
+    const uint64_t left_millis = timeout_ms - waited_millis + 1;
+    _wait_for_bus((left_millis < portMAX_DELAY / configTICK_RATE_HZ) ? (uint32_t)left_millis : portMAX_DELAY);
+  }
+  _task_waiting_for_bus = nullptr;
+
+  // the frequency is read by PS2Timing, so it is locked first
+  _begin_clocking();
+  PS2Timing timing(_config_clk_half_period_micros);
+  PS2CriticalSection cs(&_mux, _config_max_masked_micros);
+  const int ret = _read_frame(value, timing, cs);
+  cs.release();
+  _end_clocking();
+  _achieved_clk_period_nanos = timing.achieved_period_nanos();
+  _record_read(ret, *value);
+
+  return ret;
+}
 
-  if (received_parity == calculated_parity) {
-    return 0;
-  } else {
-    return -2;
+// Returns 0 if a command was received, -1 if the host is not sending, -2 on parity error.
+int PS2dev::_read_host_command(uint8_t* host_cmd) {
+  if (_timer_engine != nullptr) {
+    // the engine has already clocked the command in
+    const int ret = _timer_engine->receive(host_cmd, 0);
+    _record_read(ret, *host_cmd);
+    return ret;
   }
+  if (get_bus_state() != BusState::HOST_REQUEST_TO_SEND) {
+    return -1;
+  }
+  return read(host_cmd);
 }
 
 PS2dev::BusState PS2dev::get_bus_state() {
-  if (digitalRead(_ps2clk) == LOW) {
+  if (ps2_gpio_read(_ps2clk) == LOW) {
     return BusState::COMMUNICATION_INHIBITED;
-  } else if (digitalRead(_ps2data) == LOW) {
+  } else if (ps2_gpio_read(_ps2data) == LOW) {
     return BusState::HOST_REQUEST_TO_SEND;
   } else {
     return BusState::IDLE;
@@ -192,56 +389,412 @@ PS2dev::BusState PS2dev::get_bus_state() {
 }
 
 SemaphoreHandle_t PS2dev::get_bus_mutex_handle() { return _mutex_bus; }
-QueueHandle_t PS2dev::get_packet_queue_handle() { return _queue_packet; }
+PS2PacketQueue* PS2dev::get_packet_queue() { return &_packet_queue; }
+
+// Waits up to `ticks_to_wait` while the queue is full, so that producers can keep pace with the bus.
+// Returns 0 if the packet was queued, -1 if it was rejected. `ticket` receives the number passed to the completion callback.
+int IRAM_ATTR PS2dev::send_packet_to_queue(const PS2Packet& packet, TickType_t ticks_to_wait, uint32_t* ticket) {
+  PS2Packet queued = packet;
+  _stamp_packet(&queued);
+  if (ticket != nullptr) *ticket = queued.ticket;
+  if (_host_presence == PS2HostPresence::ABSENT) {
+    // nobody listens, and the input would be stale by the time the host is back
+    _complete_packet(queued, PS2PacketStatus::DROPPED, 0);
+    return -1;
+  }
+  const int ret = _packet_queue.push(queued, ticks_to_wait);
+  if (ret != 0) {
+    _stats.add(&PS2Stats::queue_full_drops);
+    _complete_packet(queued, PS2PacketStatus::DROPPED, 0);
+  }
+  return ret;
+}
 
-int IRAM_ATTR PS2dev::send_packet_to_queue(const PS2Packet& packet) {
-  auto packet_copy = new PS2Packet(packet);
-  return (xQueueSend(_queue_packet, &packet_copy, 0) == pdTRUE) ? 0 : -1;
+// Queues a response to the host command being processed. Responses are sent before any queued report.
+// Returns 0 on success, -1 if the queue is full.
+int PS2dev::send_response_to_queue(const PS2Packet& packet) {
+  _response_command_micros = _host_command_micros;
+  PS2Packet queued = packet;
+  _stamp_packet(&queued);
+  const int ret = _response_queue.push(queued);
+  if (ret != 0) {
+    _stats.add(&PS2Stats::queue_full_drops);
+    _complete_packet(queued, PS2PacketStatus::DROPPED, 0);
+  }
+  return ret;
 }
 
-void PS2dev::set_clk_half_period_micros(uint32_t clk_half_period_micros) { _config_clk_half_period_micros = clk_half_period_micros; }
-void PS2dev::set_byte_interval_micros(uint32_t byte_interval_micros) { _config_byte_interval_micros = byte_interval_micros; }
-uint32_t PS2dev::get_clk_half_period_micros() { return _config_clk_half_period_micros; }
+// Called once for every queued packet when it is sent, aborted or dropped. It runs in the sending task,
+// or in the producing task for dropped packets, so it must not block.
+void PS2dev::set_packet_completion_callback(PS2PacketCompletionCallback callback) { _packet_completion_callback = callback; }
+
+// Copies the counters of this port. With `reset`, the counters start again from 0 without losing any count.
+void PS2dev::get_stats(PS2Stats* stats, bool reset) { _stats.snapshot(stats, reset); }
+void PS2dev::reset_stats() { _stats.reset(); }
+
+// Records every frame and bus event of this port in `trace`, which must have begun. Pass nullptr to stop.
+void PS2dev::set_trace(PS2Trace* trace) { _trace = trace; }
+PS2Trace* PS2dev::get_trace() { return _trace; }
+
+void IRAM_ATTR PS2dev::_stamp_packet(PS2Packet* packet) {
+  uint32_t ticket = __atomic_add_fetch(&_last_ticket, 1, __ATOMIC_RELAXED);
+  // 0 means no ticket
+  if (ticket == 0) ticket = __atomic_add_fetch(&_last_ticket, 1, __ATOMIC_RELAXED);
+  packet->ticket = ticket;
+  packet->enqueued_micros = esp_timer_get_time();
+}
+
+void PS2dev::_complete_packet(const PS2Packet& packet, PS2PacketStatus status, int64_t started_micros) {
+  if (!_packet_completion_callback) return;
+  const PS2PacketCompletion completion = {packet.ticket, status, packet.enqueued_micros, started_micros, esp_timer_get_time()};
+  _packet_completion_callback(packet, completion);
+}
+
+// Time from receiving a host command to the end of its queued response, for the last response and the worst so far.
+int64_t PS2dev::get_response_latency_micros() { return _response_latency_micros; }
+int64_t PS2dev::get_max_response_latency_micros() { return _max_response_latency_micros; }
+
+void PS2dev::set_clk_half_period_micros(uint32_t clk_half_period_micros) {
+  _config_clk_half_period_micros = clk_half_period_micros;
+  _config_timing_set = true;
+}
+void PS2dev::set_byte_interval_micros(uint32_t byte_interval_micros) {
+  _config_byte_interval_micros = byte_interval_micros;
+  _config_timing_set = true;
+}
+// Bounds the time interrupts stay masked on the core clocking a frame, see PS2CriticalSection.
+// A bound shorter than a frame lets other interrupts run between bits, at the cost of stretching the clock.
+// A bound shorter than a clock period never masks them.
+void PS2dev::set_max_masked_micros(uint32_t max_masked_micros) { _config_max_masked_micros = max_masked_micros; }
+// With a timer engine, the period of its hub, which a shared hub may not have changed as configured.
+uint32_t PS2dev::get_clk_half_period_micros() {
+  return (_timer_engine != nullptr) ? _timer_engine->get_clk_half_period_micros() : _config_clk_half_period_micros;
+}
 uint32_t PS2dev::get_byte_interval_micros() { return _config_byte_interval_micros; }
+uint32_t PS2dev::get_configured_clk_period_nanos() { return 2 * _config_clk_half_period_micros * 1000; }
+// Clock period measured on the last frame clocked by the CPU, or 0 before the first frame.
+uint32_t PS2dev::get_achieved_clk_period_nanos() { return _achieved_clk_period_nanos; }
+// Must be called before begin(). The queue is allocated once in begin().
+void PS2dev::set_packet_queue_length(size_t length) { _config_packet_queue_length = length; }
+// Must be called before begin(). `storage` must hold `length` packets and outlive this object.
+void PS2dev::set_packet_queue_storage(PS2Packet* storage, size_t length) {
+  _config_packet_queue_storage = storage;
+  _config_packet_queue_length = length;
+}
+void PS2dev::set_packet_max_retries(uint8_t max_retries) { _config_packet_max_retries = max_retries; }
+uint32_t PS2dev::get_packet_retry_count() { return _packet_retry_count; }
+uint32_t PS2dev::get_packet_drop_count() { return _packet_drop_count; }
+// What send_packet_to_queue() does when the queue is full. The queue counts merged, dropped and rejected packets.
+void PS2dev::set_packet_overflow_policy(PS2OverflowPolicy policy) { _packet_queue.set_overflow_policy(policy); }
+// Must be called before begin(). Pass nullptr to bit-bang packets by write().
+void PS2dev::set_transmitter(PS2Transmitter* transmitter) { _transmitter = transmitter; }
+PS2Transmitter* PS2dev::get_transmitter() { return _transmitter; }
+// Applies the timing stored by the last calibration of this port. Returns 0 on success, -1 if there is none.
+int PS2dev::load_calibrated_timing() {
+  PS2BusTiming timing;
+  if (ps2_load_bus_timing(_ps2clk, _ps2data, &timing) != 0) return -1;
+  _config_clk_half_period_micros = timing.clk_half_period_micros;
+  _config_byte_interval_micros = timing.byte_interval_micros;
+  _config_timing_set = true;
+  return 0;
+}
+int PS2dev::erase_calibrated_timing() { return ps2_erase_bus_timing(_ps2clk, _ps2data); }
+// Searches the fastest timing the host accepts while packets are being sent, see PS2TimingCalibrator.
+// The result is applied and stored when the search ends. Call after begin(), while the host is running.
+void PS2dev::start_timing_calibration(uint16_t packets_per_step) {
+  xSemaphoreTake(_mutex_bus, portMAX_DELAY);
+  _calibrator.start(packets_per_step);
+  _on_calibration_step(true);
+  xSemaphoreGive(_mutex_bus);
+}
+bool PS2dev::is_timing_calibrating() { return _calibrator.active(); }
+
+// Classifies the host from its initialization commands and applies the preset of its class, an array indexed by
+// PS2HostClass. The preset takes effect from the classification on, so the reset delays apply to the next reset.
+// Pass nullptr to keep the configured timing.
+void PS2dev::set_host_presets(const PS2HostPreset* presets) { _config_host_presets = presets; }
+PS2HostClass PS2dev::get_host_class() { return _fingerprint.host_class(); }
+
+// CLK held low for `inhibited_millis` means the host is inhibiting the device, for `absent_millis` that it is gone.
+// While the host is absent, the tasks of the port sleep and send_packet_to_queue() rejects packets.
+void PS2dev::set_host_presence_timeouts(uint32_t inhibited_millis, uint32_t absent_millis) {
+  _config_host_inhibited_millis = inhibited_millis;
+  _config_host_absent_millis = absent_millis;
+}
+void PS2dev::set_stale_input_policy(PS2StaleInputPolicy policy) { _config_stale_input_policy = policy; }
+// Called on every change of the host presence, in the task serving host requests with the bus mutex held.
+void PS2dev::set_host_presence_callback(PS2HostPresenceCallback callback) { _host_presence_callback = callback; }
+PS2HostPresence PS2dev::get_host_presence() { return _host_presence; }
+
+// Follows how long the host has been holding CLK low. Called periodically with the bus mutex held.
+void PS2dev::_update_host_presence() {
+  const TickType_t now = xTaskGetTickCount();
+  PS2HostPresence presence = PS2HostPresence::PRESENT;
+  if (ps2_gpio_read(_ps2clk) == LOW) {
+    if (!_clk_low) {
+      _clk_low = true;
+      _clk_low_since = now;
+    }
+    const TickType_t low_ticks = now - _clk_low_since;
+    if (low_ticks >= pdMS_TO_TICKS(_config_host_absent_millis)) {
+      presence = PS2HostPresence::ABSENT;
+    } else if (low_ticks >= pdMS_TO_TICKS(_config_host_inhibited_millis)) {
+      presence = PS2HostPresence::INHIBITED;
+    }
+  } else {
+    _clk_low = false;
+  }
+  if (presence == _host_presence) return;
+  const PS2HostPresence previous = _host_presence;
+  _host_presence = presence;
+  PS2DEV_LOGI(std::string("PS2dev: host presence ") + std::to_string((int)previous) + " -> " + std::to_string((int)presence));
+  if (presence == PS2HostPresence::PRESENT) _on_host_returned(previous == PS2HostPresence::ABSENT);
+  if (_host_presence_callback) _host_presence_callback(presence);
+}
 
-void _taskfn_process_host_request(void* arg) {
+// Applies the stale input policy to the packets queued while the host was away. After an absence, the device
+// also sends its self-test result, as if it had just been plugged in, so that the host initializes it again.
+void PS2dev::_on_host_returned(bool reconnected) {
+  _host_returns++;
+  if (_config_stale_input_policy == PS2StaleInputPolicy::DROP_ALL) {
+    _packet_queue.drop_all();
+  } else if (_config_stale_input_policy == PS2StaleInputPolicy::DROP_MOTION) {
+    _packet_queue.drop_kind(PS2PacketKind::MOTION);
+  }
+  if (reconnected) {
+    _pending_host_cmd = -1;
+    _on_host_reconnected();
+  }
+}
+
+bool PS2dev::_is_stale(const PS2Packet& packet) {
+  return _config_stale_input_policy == PS2StaleInputPolicy::DROP_ALL ||
+         (_config_stale_input_policy == PS2StaleInputPolicy::DROP_MOTION && packet.kind == PS2PacketKind::MOTION);
+}
+
+void PS2dev::_on_host_reconnected() {}
+// Must be called before begin(). The engine replaces the transmitter and also clocks in host commands.
+void PS2dev::set_timer_engine(PS2TimerEngine* engine) { _timer_engine = engine; }
+// Time from the reset command to the reply to the enable data reporting command of the last host initialization.
+int64_t PS2dev::get_init_handshake_duration_micros() { return _init_handshake_duration_micros; }
+// Time from the falling edge of DATA to the start of clocking in the last host command.
+int64_t PS2dev::get_host_request_latency_micros() { return _host_request_latency_micros; }
+
+void PS2dev::_on_host_command_received(uint8_t host_cmd) {
+  if (host_cmd == HOST_CMD_RESET) {
+    _init_handshake_started_micros = esp_timer_get_time();
+  }
+  if ((host_cmd == HOST_CMD_RESEND || host_cmd == HOST_CMD_RESET) && _calibrator.active()) {
+    _on_calibration_step(_calibrator.on_host_error());
+  }
+}
+
+// Applies the timing under test, and stores it once calibration has finished. Called with the bus mutex held.
+void PS2dev::_on_calibration_step(bool changed) {
+  const PS2BusTiming timing = _calibrator.current();
+  if (changed || !_calibrator.active()) {
+    _config_clk_half_period_micros = timing.clk_half_period_micros;
+    _config_byte_interval_micros = timing.byte_interval_micros;
+  }
+  if (!_calibrator.active()) {
+    _config_timing_set = true;
+    PS2DEV_LOGI(std::string("PS2dev: calibrated clk half period ") + std::to_string(timing.clk_half_period_micros) + " us, byte interval " +
+                std::to_string(timing.byte_interval_micros) + " us");
+    if (ps2_save_bus_timing(_ps2clk, _ps2data, timing) != 0) {
+      PS2DEV_LOGW("PS2dev: failed to store calibrated timing");
+    }
+  }
+}
+
+// Applies the preset of the class the host was just classified as. An unknown host keeps the current settings,
+// and the timing is left alone when it was set, loaded or calibrated, or while calibration is searching it.
+// Called with the bus mutex held, before the byte that completed the classification is replied to.
+void PS2dev::_on_host_classified() {
+  const PS2HostClass host_class = _fingerprint.host_class();
+  PS2DEV_LOGI(std::string("PS2dev: host class ") + std::to_string((int)host_class));
+  if (_config_host_presets == nullptr || host_class == PS2HostClass::UNKNOWN) return;
+  const PS2HostPreset& preset = _config_host_presets[(size_t)host_class];
+  if (!_config_timing_set && !_calibrator.active()) {
+    _config_clk_half_period_micros = preset.clk_half_period_micros;
+    _config_byte_interval_micros = preset.byte_interval_micros;
+  }
+  _bat_delay_millis = preset.bat_delay_millis;
+  _skip_keyboard_reset_delay = preset.skip_keyboard_reset_delay;
+}
+
+void PS2dev::_on_host_command_replied(uint8_t host_cmd) {
+  if (host_cmd == HOST_CMD_ENABLE_DATA_REPORTING && _init_handshake_started_micros != 0) {
+    _init_handshake_duration_micros = esp_timer_get_time() - _init_handshake_started_micros;
+    _init_handshake_started_micros = 0;
+    PS2DEV_LOGI(std::string("PS2dev: init handshake took ") + std::to_string(_init_handshake_duration_micros) + " us");
+  }
+}
+
+// The host requests to send by pulling DATA low while CLK is inhibited, then releasing CLK.
+// The request is complete on whichever edge comes last, so both CLK rising and DATA falling are watched.
+// Our own frames pulse CLK while DATA may be low, which looks the same, so the interrupt ignores them.
+// A task waiting for the bus is woken on every other edge, to check the bus again.
+void IRAM_ATTR _isr_host_request_to_send(void* arg) {
   PS2dev* ps2dev = (PS2dev*)arg;
-  while (true) {
-    xSemaphoreTake(ps2dev->get_bus_mutex_handle(), portMAX_DELAY);
-    if (ps2dev->get_bus_state() == PS2dev::BusState::HOST_REQUEST_TO_SEND) {
-      uint8_t host_cmd;
-      if (ps2dev->read(&host_cmd) == 0) {
-        ps2dev->reply_to_host(host_cmd);
+  if (ps2dev->_clocking || (ps2dev->_timer_engine != nullptr && ps2dev->_timer_engine->is_clocking())) return;
+  if (ps2_gpio_read(ps2dev->_ps2clk) == LOW) return;
+  BaseType_t woken = pdFALSE;
+  TaskHandle_t waiting = ps2dev->_task_waiting_for_bus;
+  if (waiting != nullptr) vTaskNotifyGiveFromISR(waiting, &woken);
+  if (ps2_gpio_read(ps2dev->_ps2data) == HIGH) {
+    if (ps2dev->_host_presence == PS2HostPresence::ABSENT) {
+      // the host released CLK after a long time, wake the sleeping task to resync
+      vTaskNotifyGiveFromISR(ps2dev->_task_process_host_request, &woken);
+    }
+    portYIELD_FROM_ISR(woken);
+    return;
+  }
+  ps2dev->_host_request_detected_micros = esp_timer_get_time();
+  if (ps2dev->_trace != nullptr) ps2dev->_trace->record(PS2TraceEvent::HOST_REQUEST_TO_SEND);
+  if (ps2dev->_timer_engine != nullptr) {
+    // the engine clocks the command in and notifies the task when it is complete
+    ps2dev->_timer_engine->wake_from_isr();
+    portYIELD_FROM_ISR(woken);
+    return;
+  }
+  vTaskNotifyGiveFromISR(ps2dev->_task_process_host_request, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+void PS2dev::_process_host_request() {
+  xSemaphoreTake(_mutex_bus, portMAX_DELAY);
+  _update_host_presence();
+  const int64_t detected_micros = _host_request_detected_micros;
+  uint8_t host_cmd;
+  const int ret = _read_host_command(&host_cmd);
+  if (ret == 0) {
+    if (detected_micros != 0) {
+      _host_request_latency_micros = esp_timer_get_time() - detected_micros;
+    }
+    _dispatch_host_byte(host_cmd);
+  }
+  _host_request_detected_micros = 0;
+  xSemaphoreGive(_mutex_bus);
+  // the request was served, the bus is free for the packet waiting for it
+  if (ret != -1) _notify_bus_waiter();
+}
+
+// Passes a byte from the host to the device, as the argument of the pending command or as a new command.
+// Arguments are separate frames, so the bus is free for packets while the host prepares them.
+void PS2dev::_dispatch_host_byte(uint8_t value) {
+  _host_command_micros = esp_timer_get_time();
+  if (_fingerprint.on_host_byte(value)) _on_host_classified();
+  if (_pending_host_cmd >= 0) {
+    const uint8_t pending_cmd = _pending_host_cmd;
+    _pending_host_cmd = -1;
+    if (xTaskGetTickCount() - _pending_host_cmd_ticks <= pdMS_TO_TICKS(HOST_COMMAND_ARGUMENT_TIMEOUT_MILLIS)) {
+      const int ret = reply_to_host_argument(pending_cmd, value);
+      if (ret == HOST_COMMAND_AWAIT_ARGUMENT) {
+        _pending_host_cmd = pending_cmd;
+        _pending_host_cmd_ticks = xTaskGetTickCount();
       }
+      if (ret != -1) return;
     }
-    xSemaphoreGive(ps2dev->get_bus_mutex_handle());
-    delay(INTERVAL_CHECKING_HOST_SEND_REQUEST_MILLIS);
+  }
+
+  _stats.add_host_command(value);
+  _on_host_command_received(value);
+  if (reply_to_host(value) == HOST_COMMAND_AWAIT_ARGUMENT) {
+    _pending_host_cmd = value;
+    _pending_host_cmd_ticks = xTaskGetTickCount();
+  }
+  _on_host_command_replied(value);
+}
+
+int PS2dev::reply_to_host_argument(uint8_t host_cmd, uint8_t arg) { return -1; }
+
+// How long the task serving host requests waits for an interrupt before checking the bus anyway.
+uint32_t PS2dev::_host_check_interval_millis() {
+  if (_host_presence == PS2HostPresence::ABSENT) {
+    // only the interrupt on CLK rising wakes the task
+    return portMAX_DELAY;
+  }
+  return _config_idle_mode ? IDLE_INTERVAL_CHECKING_HOST_MILLIS : INTERVAL_CHECKING_HOST_SEND_REQUEST_MILLIS;
+}
+
+// Count the wake-ups of the tasks and the time they stay awake. With the time between two snapshots of the
+// statistics, they give the duty cycle of the port.
+int64_t PS2dev::_on_task_woken() {
+  _stats.add(&PS2Stats::wakeups);
+  return esp_timer_get_time();
+}
+void PS2dev::_on_task_waiting(int64_t woken_micros) { _stats.add(&PS2Stats::awake_micros, esp_timer_get_time() - woken_micros); }
+
+uint32_t PS2dev::_poll() { return 0; }
+
+void _taskfn_process_host_request(void* arg) {
+  PS2dev* ps2dev = (PS2dev*)arg;
+  while (true) {
+    const uint32_t check_millis = ps2dev->_host_check_interval_millis();
+    ulTaskNotifyTake(pdTRUE, (check_millis == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(check_millis));
+    const int64_t woken_micros = ps2dev->_on_task_woken();
+    ps2dev->_process_host_request();
+    ps2dev->_on_task_waiting(woken_micros);
   }
   vTaskDelete(NULL);
 }
 
 void _taskfn_send_packet(void* arg) {
   PS2dev* ps2dev = (PS2dev*)arg;
+  ps2dev->_packet_queue.set_notify_task(xTaskGetCurrentTaskHandle());
+  ps2dev->_response_queue.set_notify_task(xTaskGetCurrentTaskHandle());
   while (true) {
-    PS2Packet* packet;
-    if (xQueueReceive(ps2dev->get_packet_queue_handle(), &packet, portMAX_DELAY) == pdTRUE) {
-      xSemaphoreTake(ps2dev->get_bus_mutex_handle(), portMAX_DELAY);
-      if (ps2dev->get_bus_state() != PS2dev::BusState::IDLE) {
-        continue;
-      }
-      delayMicroseconds(ps2dev->get_byte_interval_micros());
-      for (int i = 0; i < packet->len; i++) {
-        if (ps2dev->get_bus_state() != PS2dev::BusState::IDLE) {
-          break;
-        }
-        ps2dev->write(packet->data[i]);
-        delayMicroseconds(ps2dev->get_byte_interval_micros());
+    const int64_t woken_micros = ps2dev->_on_task_woken();
+    while (ps2dev->_send_next_packet()) {
+    }
+    ps2dev->_on_task_waiting(woken_micros);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+  vTaskDelete(NULL);
+}
+
+// Merged task: woken by the host request interrupt and by every packet pushed to the queues.
+// Host requests are served between packets, and the periodic work of the device runs when it is due.
+void _taskfn_port(void* arg) {
+  PS2dev* ps2dev = (PS2dev*)arg;
+  ps2dev->_packet_queue.set_notify_task(xTaskGetCurrentTaskHandle());
+  ps2dev->_response_queue.set_notify_task(xTaskGetCurrentTaskHandle());
+  TickType_t next_poll = xTaskGetTickCount();
+  bool polling = true;
+  while (true) {
+    const uint32_t check_millis = ps2dev->_host_check_interval_millis();
+    // while the host is absent, nothing is polled or sent until the interrupt on CLK rising tells it is back
+    const bool absent = (check_millis == portMAX_DELAY);
+    TickType_t wait = absent ? portMAX_DELAY : pdMS_TO_TICKS(check_millis);
+    if (polling && !absent) {
+      const TickType_t until_poll = next_poll - xTaskGetTickCount();
+      if ((int32_t)until_poll <= 0) {
+        wait = 0;
+      } else if (until_poll < wait) {
+        wait = until_poll;
       }
-      xSemaphoreGive(ps2dev->get_bus_mutex_handle());
     }
-    delete packet;
+    ulTaskNotifyTake(pdTRUE, wait);
+    const int64_t woken_micros = ps2dev->_on_task_woken();
+
+    ps2dev->_process_host_request();
+    while (ps2dev->_send_next_packet()) {
+      ps2dev->_process_host_request();
+    }
+    if (!polling && (ps2dev->_config_idle_mode || ps2dev->_host_presence != PS2HostPresence::ABSENT)) {
+      // the device stops polling while the host is absent, and in idle mode when it has nothing to do,
+      // until input or the return of the host wakes the task
+      polling = true;
+      next_poll = xTaskGetTickCount();
+    }
+    if (polling && (int32_t)(xTaskGetTickCount() - next_poll) >= 0) {
+      const uint32_t interval_millis = ps2dev->_poll();
+      polling = (interval_millis != 0);
+      next_poll = xTaskGetTickCount() + pdMS_TO_TICKS(interval_millis);
+    }
+    ps2dev->_on_task_waiting(woken_micros);
   }
   vTaskDelete(NULL);
 }
 
-}  // namespace esp32_ps2dev
\ No newline at end of file
+}  // namespace esp32_ps2dev
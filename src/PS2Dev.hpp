@@ -1,11 +1,23 @@
 #ifndef C05CFFFE_E405_4DD0_A541_EC07FFA90E99
 #define C05CFFFE_E405_4DD0_A541_EC07FFA90E99
 
+#include <esp_timer.h>
+
 #include <initializer_list>
 #include <stack>
 
 #include "Arduino.h"
 #include "Log.hpp"
+#include "PS2BitBang.hpp"
+#include "PS2Frame.hpp"
+#include "PS2HostFingerprint.hpp"
+#include "PS2PacketQueue.hpp"
+#include "PS2Power.hpp"
+#include "PS2Stats.hpp"
+#include "PS2Trace.hpp"
+#include "PS2TimerEngine.hpp"
+#include "PS2TimingCalibrator.hpp"
+#include "PS2Transmitter.hpp"
 
 namespace esp32_ps2dev {
 
@@ -16,19 +28,56 @@ const uint32_t DEFAULT_CLK_HALF_PERIOD_MICROS = 30;
 // Based on observation of the mouse signal waveform using an oscilloscope, there appears to be an interval of 1 to 2 clock cycles.
 // ref. https://youtu.be/UqRDLWGLCEk
 const uint32_t DEFAULT_BYTE_INTERVAL_MICROS = 100;
+// Each frame is clocked with interrupts masked from its first to its last bit unless a bound is set.
+// Interrupts are unmasked between the bytes of a packet.
+const uint32_t DEFAULT_MAX_MASKED_MICROS = MASKED_MICROS_UNBOUNDED;
 // The device should check for "HOST_REQUEST_TO_SEND" at a interval not exceeding 10 milliseconds.
+// Requests are normally picked up by edge interrupts on CLK and DATA, polling is kept as a fallback.
 const uint32_t INTERVAL_CHECKING_HOST_SEND_REQUEST_MILLIS = 9;
+// In idle mode, the interrupts alone pick up host requests and the bus is polled at this longer interval,
+// to follow the host presence and as a fallback.
+const uint32_t IDLE_INTERVAL_CHECKING_HOST_MILLIS = 100;
 
-const int PACKET_QUEUE_LENGTH = 20;
+// Responses to host commands are few at a time, their queue is small and allocated within PS2dev.
+const size_t RESPONSE_QUEUE_LENGTH = 4;
+// Number of times a packet interrupted by the host is sent again before it is dropped.
+const uint8_t DEFAULT_PACKET_MAX_RETRIES = 3;
 const UBaseType_t DEFAULT_TASK_PRIORITY = 10;
 const BaseType_t DEFAULT_TASK_CORE = APP_CPU_NUM;
+// Returned by reply_to_host() for commands followed by an argument byte. The next byte from the host is passed to
+// reply_to_host_argument(), which returns 0 when done, or -1 if the byte is not an argument but a new command.
+const int HOST_COMMAND_AWAIT_ARGUMENT = 1;
+// The pending command is abandoned if its argument does not arrive within this time.
+const uint32_t HOST_COMMAND_ARGUMENT_TIMEOUT_MILLIS = 100;
+const uint32_t DEFAULT_TASK_STACK_SIZE = 4096;
+// One task does the work of all tasks of the port, so it needs less stack than all of them together.
+const uint32_t DEFAULT_MERGED_TASK_STACK_SIZE = 3072;
+// A host holds CLK low for a few milliseconds at most while it is busy. Held longer, the host is inhibiting the device,
+// and held much longer, the host is off, unplugged or suspended.
+const uint32_t DEFAULT_HOST_INHIBITED_MILLIS = 200;
+const uint32_t DEFAULT_HOST_ABSENT_MILLIS = 2000;
 
-class PS2Packet {
- public:
-  uint8_t len;
-  uint8_t data[16];
+enum class PS2HostPresence : uint8_t {
+  PRESENT,
+  INHIBITED,
+  ABSENT,
+};
+
+// What happens to the packets queued while the host was inhibiting the bus, once it is back.
+enum class PS2StaleInputPolicy : uint8_t {
+  KEEP,
+  DROP_MOTION,
+  DROP_ALL,
 };
 
+typedef std::function<void(const PS2Packet& packet, const PS2PacketCompletion& completion)> PS2PacketCompletionCallback;
+typedef std::function<void(PS2HostPresence presence)> PS2HostPresenceCallback;
+
+void _isr_host_request_to_send(void* arg);
+void _taskfn_process_host_request(void* arg);
+void _taskfn_send_packet(void* arg);
+void _taskfn_port(void* arg);
+
 class PS2dev {
  public:
   PS2dev(int clk, int data);
@@ -40,37 +89,164 @@ class PS2dev {
   };
 
   void config(UBaseType_t task_priority, BaseType_t task_core);
+  void set_task_stack_size(uint32_t stack_size);
+  void set_merged_task(StackType_t* stack = nullptr, uint32_t stack_size = DEFAULT_MERGED_TASK_STACK_SIZE);
+  void set_idle_mode(bool enabled);
+  UBaseType_t get_host_task_stack_high_water_mark();
+  UBaseType_t get_send_task_stack_high_water_mark();
   void begin();
   int write(unsigned char data);
+  int write_packet(const PS2Packet& packet);
+  int write_packet(const PS2Packet& packet, uint32_t byte_gap_micros);
   int read(unsigned char* data, uint64_t timeout_ms = 0);
   virtual int reply_to_host(uint8_t host_cmd) = 0;
-  BusState get_bus_state();
+  virtual int reply_to_host_argument(uint8_t host_cmd, uint8_t arg);
+  virtual BusState get_bus_state();
   SemaphoreHandle_t get_bus_mutex_handle();
-  QueueHandle_t get_packet_queue_handle();
-  int send_packet_to_queue(const PS2Packet& packet);
+  PS2PacketQueue* get_packet_queue();
+  int send_packet_to_queue(const PS2Packet& packet, TickType_t ticks_to_wait = 0, uint32_t* ticket = nullptr);
+  int send_response_to_queue(const PS2Packet& packet);
+  void set_packet_completion_callback(PS2PacketCompletionCallback callback);
+  void get_stats(PS2Stats* stats, bool reset = false);
+  void reset_stats();
+  void set_trace(PS2Trace* trace);
+  PS2Trace* get_trace();
+  int64_t get_response_latency_micros();
+  int64_t get_max_response_latency_micros();
   void set_clk_half_period_micros(uint32_t clk_half_period_micros);
   void set_byte_interval_micros(uint32_t byte_interval_micros);
+  void set_max_masked_micros(uint32_t max_masked_micros);
   uint32_t get_clk_half_period_micros();
   uint32_t get_byte_interval_micros();
+  uint32_t get_configured_clk_period_nanos();
+  uint32_t get_achieved_clk_period_nanos();
+  void set_packet_queue_length(size_t length);
+  void set_packet_queue_storage(PS2Packet* storage, size_t length);
+  void set_packet_max_retries(uint8_t max_retries);
+  void set_packet_overflow_policy(PS2OverflowPolicy policy);
+  uint32_t get_packet_retry_count();
+  uint32_t get_packet_drop_count();
+  void set_transmitter(PS2Transmitter* transmitter);
+  PS2Transmitter* get_transmitter();
+  void set_timer_engine(PS2TimerEngine* engine);
+  int64_t get_init_handshake_duration_micros();
+  int64_t get_host_request_latency_micros();
+  int load_calibrated_timing();
+  int erase_calibrated_timing();
+  void start_timing_calibration(uint16_t packets_per_step = DEFAULT_CALIBRATION_PACKETS_PER_STEP);
+  bool is_timing_calibrating();
+  void set_host_presets(const PS2HostPreset* presets = DEFAULT_HOST_PRESETS);
+  PS2HostClass get_host_class();
+  void set_host_presence_timeouts(uint32_t inhibited_millis, uint32_t absent_millis);
+  void set_stale_input_policy(PS2StaleInputPolicy policy);
+  void set_host_presence_callback(PS2HostPresenceCallback callback);
+  PS2HostPresence get_host_presence();
 
  protected:
   int _ps2clk;
   int _ps2data;
   UBaseType_t _config_task_priority = DEFAULT_TASK_PRIORITY;
   BaseType_t _config_task_core = DEFAULT_TASK_CORE;
+  uint32_t _config_task_stack_size = DEFAULT_TASK_STACK_SIZE;
+  bool _config_merged_task = false;
+  StackType_t* _config_merged_task_stack = nullptr;
+  uint32_t _config_merged_task_stack_size = DEFAULT_MERGED_TASK_STACK_SIZE;
+  StaticTask_t _merged_task_buffer;
+  bool _config_idle_mode = false;
+  PS2PmLock _pm_lock;
+  volatile bool _clocking = false;
   uint32_t _config_clk_half_period_micros = DEFAULT_CLK_HALF_PERIOD_MICROS;
   uint32_t _config_byte_interval_micros = DEFAULT_BYTE_INTERVAL_MICROS;
-  TaskHandle_t _task_process_host_request;
-  TaskHandle_t _task_send_packet;
-  QueueHandle_t _queue_packet;
+  // Set by the setters, a loaded or a finished calibration. Host presets then leave the timing alone.
+  bool _config_timing_set = false;
+  uint32_t _config_max_masked_micros = DEFAULT_MAX_MASKED_MICROS;
+  // Shared by all frames of the port, so two cores never clock the same port at once.
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  TaskHandle_t _task_process_host_request = nullptr;
+  TaskHandle_t _task_send_packet = nullptr;
+  // A task blocked until the bus changes, notified by the interrupt on CLK and DATA and by the end of a host request.
+  volatile TaskHandle_t _task_waiting_for_bus = nullptr;
+  size_t _config_packet_queue_length = DEFAULT_PACKET_QUEUE_LENGTH;
+  PS2Packet* _config_packet_queue_storage = nullptr;
+  PS2PacketQueue _packet_queue;
+  PS2Packet _response_queue_storage[RESPONSE_QUEUE_LENGTH];
+  PS2PacketQueue _response_queue;
+  PS2PacketCompletionCallback _packet_completion_callback;
+  PS2StatsBlock _stats;
+  PS2Trace* _trace = nullptr;
+  uint32_t _last_ticket = 0;
+  int64_t _host_command_micros = 0;
+  int64_t _response_command_micros = 0;
+  int64_t _response_latency_micros = 0;
+  int64_t _max_response_latency_micros = 0;
   SemaphoreHandle_t _mutex_bus;
+  StaticSemaphore_t _mutex_bus_buffer;
+  uint8_t _config_packet_max_retries = DEFAULT_PACKET_MAX_RETRIES;
+  uint32_t _packet_retry_count = 0;
+  uint32_t _packet_drop_count = 0;
+  PS2Transmitter* _transmitter = nullptr;
+  PS2TimerEngine* _timer_engine = nullptr;
+  uint32_t _achieved_clk_period_nanos = 0;
+  volatile int64_t _host_request_detected_micros = 0;
+  int64_t _host_request_latency_micros = 0;
+  int64_t _init_handshake_started_micros = 0;
+  int64_t _init_handshake_duration_micros = 0;
+  PS2TimingCalibrator _calibrator;
+  PS2HostFingerprint _fingerprint;
+  const PS2HostPreset* _config_host_presets = nullptr;
+  uint32_t _bat_delay_millis = 0;
+  bool _skip_keyboard_reset_delay = false;
+  uint32_t _config_host_inhibited_millis = DEFAULT_HOST_INHIBITED_MILLIS;
+  uint32_t _config_host_absent_millis = DEFAULT_HOST_ABSENT_MILLIS;
+  PS2StaleInputPolicy _config_stale_input_policy = PS2StaleInputPolicy::KEEP;
+  PS2HostPresenceCallback _host_presence_callback;
+  volatile PS2HostPresence _host_presence = PS2HostPresence::PRESENT;
+  bool _clk_low = false;
+  TickType_t _clk_low_since = 0;
+  // Counts the returns of the host, so that a packet waiting for the bus knows it may have become stale.
+  volatile uint32_t _host_returns = 0;
+  int16_t _pending_host_cmd = -1;
+  TickType_t _pending_host_cmd_ticks = 0;
   void golo(int pin);
   void gohi(int pin);
   void ack();
-};
+  void _send_queued_packet(const PS2Packet& packet);
+  int _write_byte(unsigned char data);
+  int _write_packet(const PS2Packet& packet, uint32_t byte_gap_micros, size_t* sent);
+  void _begin_clocking();
+  void _end_clocking();
+  void _wait_for_bus(uint32_t timeout_millis);
+  void _notify_bus_waiter();
+  void _record_write(int ret, const uint8_t* data, size_t len, size_t sent, int64_t started_micros);
+  void _record_read(int ret, uint8_t value);
+  bool _send_next_packet();
+  void _stamp_packet(PS2Packet* packet);
+  void _complete_packet(const PS2Packet& packet, PS2PacketStatus status, int64_t started_micros);
+  void _process_host_request();
+  uint32_t _host_check_interval_millis();
+  int64_t _on_task_woken();
+  void _on_task_waiting(int64_t woken_micros);
+  void _dispatch_host_byte(uint8_t value);
+  // Periodic work of the device, called by the merged task. Returns the milliseconds until the next call, 0 for none.
+  virtual uint32_t _poll();
+  int _read_host_command(uint8_t* host_cmd);
+  virtual int _write_frame(uint16_t frame, PS2Timing& timing, PS2CriticalSection& cs);
+  virtual int _read_frame(uint8_t* value, PS2Timing& timing, PS2CriticalSection& cs);
+  void _on_host_command_received(uint8_t host_cmd);
+  void _on_host_command_replied(uint8_t host_cmd);
+  void _on_calibration_step(bool changed);
+  void _on_host_classified();
+  void _update_host_presence();
+  void _on_host_returned(bool reconnected);
+  bool _is_stale(const PS2Packet& packet);
+  // Called when the host is back after it was absent, to send the self-test result and start over.
+  virtual void _on_host_reconnected();
 
-void _taskfn_process_host_request(void* arg);
-void _taskfn_send_packet(void* arg);
+  friend void _isr_host_request_to_send(void* arg);
+  friend void _taskfn_process_host_request(void* arg);
+  friend void _taskfn_send_packet(void* arg);
+  friend void _taskfn_port(void* arg);
+};
 
 }  // namespace esp32_ps2dev
 
@@ -0,0 +1,51 @@
+#include "PS2DevGroup.hpp"
+
+namespace esp32_ps2dev {
+
+PS2DevGroup::PS2DevGroup(PS2PacketKind kind, bool skip_late) : _kind(kind), _skip_late(skip_late) {}
+
+int PS2DevGroup::_add(PS2dev& port) {
+  if (_count == DEV_GROUP_MAX_PORTS) return -1;
+  const size_t index = _count;
+  _ports[index] = &port;
+  _count++;
+  port.set_packet_completion_callback(
+      [this, index](const PS2Packet& packet, const PS2PacketCompletion& completion) { _on_packet_completion(index, packet, completion); });
+  return 0;
+}
+
+size_t PS2DevGroup::size() { return _count; }
+void PS2DevGroup::set_max_queue_depth(size_t depth) { _config_max_queue_depth = depth; }
+uint32_t PS2DevGroup::get_late_count(size_t index) { return (index < _count) ? _late_count[index] : 0; }
+
+size_t PS2DevGroup::_dispatch(const PS2Packet* const* packets, bool may_skip, TickType_t ticks_to_wait) {
+  size_t queued = 0;
+  const int64_t started_micros = esp_timer_get_time();
+  for (size_t i = 0; i < _count; i++) {
+    if (packets[i] == nullptr) continue;
+    if (_config_max_queue_depth > 0 && _ports[i]->get_packet_queue()->size() >= _config_max_queue_depth) {
+      _late_count[i]++;
+      if (_skip_late && may_skip) continue;
+    }
+    if (_ports[i]->send_packet_to_queue(*packets[i], ticks_to_wait) == 0) queued++;
+  }
+  _dispatch_micros = esp_timer_get_time() - started_micros;
+  return queued;
+}
+
+int64_t PS2DevGroup::get_lag_micros(size_t index) { return (index < _count) ? _lag_micros[index] : 0; }
+int64_t PS2DevGroup::get_max_lag_micros(size_t index) { return (index < _count) ? _max_lag_micros[index] : 0; }
+int64_t PS2DevGroup::get_dispatch_micros() { return _dispatch_micros; }
+
+void PS2DevGroup::reset_lag() {
+  for (size_t i = 0; i < _count; i++) _max_lag_micros[i] = 0;
+}
+
+void PS2DevGroup::_on_packet_completion(size_t index, const PS2Packet& packet, const PS2PacketCompletion& completion) {
+  if (packet.kind != _kind || completion.status != PS2PacketStatus::SENT) return;
+  const int64_t lag_micros = completion.finished_micros - completion.enqueued_micros;
+  _lag_micros[index] = lag_micros;
+  if (lag_micros > _max_lag_micros[index]) _max_lag_micros[index] = lag_micros;
+}
+
+}  // namespace esp32_ps2dev
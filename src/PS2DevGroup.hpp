@@ -0,0 +1,55 @@
+#ifndef A2C54DF1_CB03_43FF_8CE4_E382724ED110
+#define A2C54DF1_CB03_43FF_8CE4_E382724ED110
+
+#include "PS2Dev.hpp"
+
+namespace esp32_ps2dev {
+
+const size_t DEV_GROUP_MAX_PORTS = 8;
+// A host is late when its packet queue holds this many packets when a new one is dispatched.
+const size_t DEFAULT_GROUP_MAX_QUEUE_DEPTH = 4;
+
+// Ports of one kind of device, one per host, which receive the same packets. Base of PS2MouseGroup and PS2KeyboardGroup.
+// Packets are queued on every port back to back, then each port sends them from its own task, so a host that holds
+// its bus falls behind the others. A host is late when its queue is at the maximum depth: depending on the group,
+// it is skipped, which keeps it within that many packets of the other hosts, or only counted.
+//
+// The group takes over the packet completion callback of its ports to measure the lag of each host, from the moment
+// a packet is queued to the moment its last byte is on the wire. Do not set another callback on them.
+class PS2DevGroup {
+ public:
+  size_t size();
+  // 0 disables the bound.
+  void set_max_queue_depth(size_t depth);
+  // Packets the host at `index` was late for, skipped or not.
+  uint32_t get_late_count(size_t index);
+  // Lag of the last packet sent to the host at `index`, and the largest since reset_lag().
+  int64_t get_lag_micros(size_t index);
+  int64_t get_max_lag_micros(size_t index);
+  // Time taken to queue the last packet on all hosts.
+  int64_t get_dispatch_micros();
+  void reset_lag();
+
+ protected:
+  // Only packets of `kind` count for the lag, responses to host commands do not.
+  PS2DevGroup(PS2PacketKind kind, bool skip_late);
+  // Returns 0 on success, -1 if the group is full.
+  int _add(PS2dev& port);
+  // Queues packets[i] on port i, nullptr skips the port. Late ports are skipped only if `may_skip`.
+  // Returns the number of hosts the packet was queued for.
+  size_t _dispatch(const PS2Packet* const* packets, bool may_skip, TickType_t ticks_to_wait);
+  void _on_packet_completion(size_t index, const PS2Packet& packet, const PS2PacketCompletion& completion);
+  PS2dev* _ports[DEV_GROUP_MAX_PORTS] = {};
+  size_t _count = 0;
+  PS2PacketKind _kind;
+  bool _skip_late;
+  size_t _config_max_queue_depth = DEFAULT_GROUP_MAX_QUEUE_DEPTH;
+  uint32_t _late_count[DEV_GROUP_MAX_PORTS] = {};
+  int64_t _lag_micros[DEV_GROUP_MAX_PORTS] = {};
+  int64_t _max_lag_micros[DEV_GROUP_MAX_PORTS] = {};
+  int64_t _dispatch_micros = 0;
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* A2C54DF1_CB03_43FF_8CE4_E382724ED110 */
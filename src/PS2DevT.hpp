@@ -0,0 +1,42 @@
+#ifndef C7D24819_C427_464A_AA07_939C24EADFCE
+#define C7D24819_C427_464A_AA07_939C24EADFCE
+
+#include "PS2BitBang.hpp"
+#include "PS2Dev.hpp"
+
+namespace esp32_ps2dev {
+
+// PS2dev variant with pins fixed at compile time, so every edge is a single register write.
+// `Device` is PS2Mouse, PS2Keyboard or another subclass of PS2dev.
+//
+//   esp32_ps2dev::PS2devT<17, 16, esp32_ps2dev::PS2Mouse> mouse;
+template <int CLK, int DATA, class Device>
+class PS2devT : public Device {
+ public:
+  PS2devT() : Device(CLK, DATA) {}
+
+  PS2dev::BusState get_bus_state() {
+    if (PS2PinsT<CLK, DATA>::clk_read() == LOW) {
+      return PS2dev::BusState::COMMUNICATION_INHIBITED;
+    } else if (PS2PinsT<CLK, DATA>::data_read() == LOW) {
+      return PS2dev::BusState::HOST_REQUEST_TO_SEND;
+    } else {
+      return PS2dev::BusState::IDLE;
+    }
+  }
+
+ protected:
+  int _write_frame(uint16_t frame, PS2Timing& timing, PS2CriticalSection& cs) {
+    PS2PinsT<CLK, DATA> pins;
+    return ps2_write_frame(pins, frame, timing, cs);
+  }
+
+  int _read_frame(uint8_t* value, PS2Timing& timing, PS2CriticalSection& cs) {
+    PS2PinsT<CLK, DATA> pins;
+    return ps2_read_frame(pins, value, timing, cs);
+  }
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* C7D24819_C427_464A_AA07_939C24EADFCE */
@@ -0,0 +1,66 @@
+#include "PS2Frame.hpp"
+
+namespace esp32_ps2dev {
+
+// Longest duration a single symbol can hold. RMT items have 15-bit duration fields.
+const uint16_t MAX_SYMBOL_DURATION_MICROS = 0x7FFF;
+
+// Appends a symbol to `out`, merging it into the previous one when the level does not change.
+static bool append_symbol(PS2Symbol* out, size_t& n, size_t max_symbols, uint8_t level, uint32_t duration_micros) {
+  while (duration_micros > 0) {
+    if (n > 0 && out[n - 1].level == level && out[n - 1].duration_micros < MAX_SYMBOL_DURATION_MICROS) {
+      uint32_t room = MAX_SYMBOL_DURATION_MICROS - out[n - 1].duration_micros;
+      uint32_t added = duration_micros < room ? duration_micros : room;
+      out[n - 1].duration_micros += added;
+      duration_micros -= added;
+      continue;
+    }
+    if (n >= max_symbols) return false;
+    out[n].level = level;
+    out[n].duration_micros = 0;
+    n++;
+  }
+  return true;
+}
+
+PS2FrameEncoder::PS2FrameEncoder(uint32_t clk_half_period_micros, uint32_t byte_interval_micros)
+    : _clk_half_period_micros(clk_half_period_micros), _byte_interval_micros(byte_interval_micros) {}
+
+size_t PS2FrameEncoder::max_symbols(size_t len) { return 24 * len + 2; }
+
+// The timing follows PS2dev::write():
+// CLK is released for a quarter period, then pulsed low for a half period once per bit,
+// and the last high phase after the stop bit lasts a quarter period.
+size_t PS2FrameEncoder::encode_clk(size_t len, PS2Symbol* out, size_t max_symbols) const {
+  const uint32_t half = _clk_half_period_micros;
+  const uint32_t quarter = _clk_half_period_micros / 2;
+  size_t n = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (!append_symbol(out, n, max_symbols, 1, quarter)) return 0;
+    for (uint8_t bit = 0; bit < FRAME_BITS; bit++) {
+      if (!append_symbol(out, n, max_symbols, 0, half)) return 0;
+      if (!append_symbol(out, n, max_symbols, 1, (bit + 1 < FRAME_BITS) ? half : quarter)) return 0;
+    }
+    if (i + 1 < len && !append_symbol(out, n, max_symbols, 1, _byte_interval_micros)) return 0;
+  }
+  return n;
+}
+
+// Each bit is held for a whole clock period starting a quarter period before the falling edge of CLK.
+size_t PS2FrameEncoder::encode_data(const uint8_t* data, size_t len, PS2Symbol* out, size_t max_symbols) const {
+  const uint32_t half = _clk_half_period_micros;
+  const uint32_t quarter = _clk_half_period_micros / 2;
+  size_t n = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint16_t frame = encode_frame(data[i]);
+    for (uint8_t bit = 0; bit < FRAME_BITS; bit++) {
+      // the stop bit is shortened so that both lines have the same length even if the half period is odd
+      uint32_t duration = (bit + 1 < FRAME_BITS) ? 2 * half : 2 * quarter + half;
+      if (!append_symbol(out, n, max_symbols, (frame >> bit) & 0x01, duration)) return 0;
+    }
+    if (i + 1 < len && !append_symbol(out, n, max_symbols, 1, _byte_interval_micros)) return 0;
+  }
+  return n;
+}
+
+}  // namespace esp32_ps2dev
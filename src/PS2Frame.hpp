@@ -0,0 +1,68 @@
+#ifndef A318D2E4_74F1_4C1B_ACBD_789441ECFDBC
+#define A318D2E4_74F1_4C1B_ACBD_789441ECFDBC
+
+// This header does not depend on the Arduino core, so frame encoding can be built and verified on a host machine.
+#include <stddef.h>
+#include <stdint.h>
+
+namespace esp32_ps2dev {
+
+// A device-to-host frame consists of 11 bits sent LSB first:
+// start bit (0), 8 data bits, odd parity bit, stop bit (1).
+const uint8_t FRAME_BITS = 11;
+
+constexpr uint8_t odd_parity(uint8_t data) {
+  return 1 ^ ((data ^ (data >> 1) ^ (data >> 2) ^ (data >> 3) ^ (data >> 4) ^ (data >> 5) ^ (data >> 6) ^ (data >> 7)) & 0x01);
+}
+
+constexpr uint16_t make_frame(uint8_t data) { return (uint16_t)((1 << 10) | (odd_parity(data) << 9) | (data << 1)); }
+
+// Precomputed frames for every byte, so the bit-banging loop only shifts a word.
+#define PS2DEV_FRAME_ROW(high)                                                                                                   \
+  make_frame((high) | 0x0), make_frame((high) | 0x1), make_frame((high) | 0x2), make_frame((high) | 0x3), make_frame((high) | 0x4), \
+      make_frame((high) | 0x5), make_frame((high) | 0x6), make_frame((high) | 0x7), make_frame((high) | 0x8),                     \
+      make_frame((high) | 0x9), make_frame((high) | 0xA), make_frame((high) | 0xB), make_frame((high) | 0xC),                     \
+      make_frame((high) | 0xD), make_frame((high) | 0xE), make_frame((high) | 0xF)
+constexpr uint16_t FRAME_TABLE[256] = {
+    PS2DEV_FRAME_ROW(0x00), PS2DEV_FRAME_ROW(0x10), PS2DEV_FRAME_ROW(0x20), PS2DEV_FRAME_ROW(0x30),
+    PS2DEV_FRAME_ROW(0x40), PS2DEV_FRAME_ROW(0x50), PS2DEV_FRAME_ROW(0x60), PS2DEV_FRAME_ROW(0x70),
+    PS2DEV_FRAME_ROW(0x80), PS2DEV_FRAME_ROW(0x90), PS2DEV_FRAME_ROW(0xA0), PS2DEV_FRAME_ROW(0xB0),
+    PS2DEV_FRAME_ROW(0xC0), PS2DEV_FRAME_ROW(0xD0), PS2DEV_FRAME_ROW(0xE0), PS2DEV_FRAME_ROW(0xF0),
+};
+#undef PS2DEV_FRAME_ROW
+
+static_assert(FRAME_TABLE[0x00] == 0x600, "even number of ones sets the parity bit");
+static_assert(FRAME_TABLE[0x01] == 0x402, "odd number of ones clears the parity bit");
+static_assert(FRAME_TABLE[0xFA] == 0x7F4, "ACK frame");
+
+// Returns the 11-bit frame for `data`. Bit 0 is the start bit and bit 10 is the stop bit.
+inline uint16_t encode_frame(uint8_t data) { return FRAME_TABLE[data]; }
+
+// A line level held for a duration, which is a half of an RMT item.
+struct PS2Symbol {
+  uint8_t level;
+  uint16_t duration_micros;
+};
+
+// Converts bytes into level/duration symbol streams for the CLK and DATA lines.
+// Both streams start at the same instant and have the same total length.
+// DATA changes in the middle of the CLK high phase, so a small skew between the two lines is tolerated.
+class PS2FrameEncoder {
+ public:
+  PS2FrameEncoder(uint32_t clk_half_period_micros, uint32_t byte_interval_micros);
+
+  // Each function returns the number of symbols written to `out`, or 0 if `max_symbols` is not enough.
+  size_t encode_clk(size_t len, PS2Symbol* out, size_t max_symbols) const;
+  size_t encode_data(const uint8_t* data, size_t len, PS2Symbol* out, size_t max_symbols) const;
+
+  // Upper bound of symbols needed for `len` bytes on either line.
+  static size_t max_symbols(size_t len);
+
+ protected:
+  uint32_t _clk_half_period_micros;
+  uint32_t _byte_interval_micros;
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* A318D2E4_74F1_4C1B_ACBD_789441ECFDBC */
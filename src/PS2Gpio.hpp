@@ -0,0 +1,85 @@
+#ifndef D4FC99DE_1980_4D82_9209_26D4B7650FF3
+#define D4FC99DE_1980_4D82_9209_26D4B7650FF3
+
+#include <driver/gpio.h>
+#include <soc/gpio_struct.h>
+#include <soc/soc_caps.h>
+
+#include "Arduino.h"
+
+namespace esp32_ps2dev {
+
+// PS/2 lines are open-collector. Pins are configured once as open-drain outputs with the input enabled,
+// then driven through the GPIO output registers: writing 1 releases the line, writing 0 pulls it low.
+// This avoids pinMode() and digitalWrite() on every edge, each of which costs up to a few microseconds.
+// The pad is first switched to its GPIO function, which is not the reset function of every pad (GPIO 12 to 15 are JTAG).
+inline void ps2_gpio_init(int pin) {
+  gpio_reset_pin((gpio_num_t)pin);
+  // like pinMode(INPUT), the lines rely on the pull-ups of the host
+  gpio_pullup_dis((gpio_num_t)pin);
+  gpio_set_level((gpio_num_t)pin, 1);
+  gpio_set_direction((gpio_num_t)pin, GPIO_MODE_INPUT_OUTPUT_OD);
+}
+
+inline void IRAM_ATTR ps2_gpio_low(int pin) {
+#if SOC_GPIO_PIN_COUNT > 32
+  if (pin >= 32) {
+    GPIO.out1_w1tc.val = 1UL << (pin - 32);
+    return;
+  }
+#endif
+  GPIO.out_w1tc = 1UL << pin;
+}
+
+inline void IRAM_ATTR ps2_gpio_release(int pin) {
+#if SOC_GPIO_PIN_COUNT > 32
+  if (pin >= 32) {
+    GPIO.out1_w1ts.val = 1UL << (pin - 32);
+    return;
+  }
+#endif
+  GPIO.out_w1ts = 1UL << pin;
+}
+
+inline int IRAM_ATTR ps2_gpio_read(int pin) {
+#if SOC_GPIO_PIN_COUNT > 32
+  if (pin >= 32) {
+    return (GPIO.in1.val >> (pin - 32)) & 0x01;
+  }
+#endif
+  return (GPIO.in >> pin) & 0x01;
+}
+
+// Pin pair resolved at run time, used by PS2dev.
+class PS2Pins {
+ public:
+  PS2Pins(int clk, int data) : _clk(clk), _data(data) {}
+  inline void clk_low() { ps2_gpio_low(_clk); }
+  inline void clk_release() { ps2_gpio_release(_clk); }
+  inline int clk_read() { return ps2_gpio_read(_clk); }
+  inline void data_low() { ps2_gpio_low(_data); }
+  inline void data_release() { ps2_gpio_release(_data); }
+  inline int data_read() { return ps2_gpio_read(_data); }
+
+ protected:
+  int _clk;
+  int _data;
+};
+
+// Pin pair resolved at compile time, used by PS2devT. The register and the mask fold into constants.
+template <int CLK, int DATA>
+class PS2PinsT {
+ public:
+  static_assert(CLK >= 0 && CLK < SOC_GPIO_PIN_COUNT, "invalid CLK pin");
+  static_assert(DATA >= 0 && DATA < SOC_GPIO_PIN_COUNT, "invalid DATA pin");
+  static inline void clk_low() { ps2_gpio_low(CLK); }
+  static inline void clk_release() { ps2_gpio_release(CLK); }
+  static inline int clk_read() { return ps2_gpio_read(CLK); }
+  static inline void data_low() { ps2_gpio_low(DATA); }
+  static inline void data_release() { ps2_gpio_release(DATA); }
+  static inline int data_read() { return ps2_gpio_read(DATA); }
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* D4FC99DE_1980_4D82_9209_26D4B7650FF3 */
@@ -0,0 +1,104 @@
+#include "PS2Host.hpp"
+
+#include "PS2Frame.hpp"
+#include "PS2Gpio.hpp"
+
+namespace esp32_ps2dev {
+
+const uint8_t HOST_ACK = 0xFA;
+const uint8_t HOST_RESEND = 0xFE;
+
+PS2Host::PS2Host(int clk, int data) : _clk(clk), _data(data), _framer(PS2Pins(clk, data)) {}
+
+void PS2Host::begin() {
+  ps2_gpio_init(_clk);
+  ps2_gpio_init(_data);
+  _rx_queue = xQueueCreateStatic(HOST_RX_QUEUE_LENGTH, sizeof(RxFrame), _rx_queue_storage, &_rx_queue_buffer);
+  attachInterruptArg(_clk, _isr_host_clk_falling, this, FALLING);
+}
+
+void PS2Host::inhibit() {
+  taskENTER_CRITICAL(&_mux);
+  _framer.inhibit();
+  taskEXIT_CRITICAL(&_mux);
+}
+
+void PS2Host::release() {
+  taskENTER_CRITICAL(&_mux);
+  _framer.release();
+  taskEXIT_CRITICAL(&_mux);
+}
+
+int PS2Host::write(uint8_t value) {
+  // inhibit first, a frame from the device is aborted and sent again later
+  inhibit();
+  delayMicroseconds(HOST_INHIBIT_BEFORE_SEND_MICROS);
+  ulTaskNotifyTake(pdTRUE, 0);
+  taskENTER_CRITICAL(&_mux);
+  _tx_task = xTaskGetCurrentTaskHandle();
+  _framer.start_send(value);
+  taskEXIT_CRITICAL(&_mux);
+
+  if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HOST_SEND_TIMEOUT_MILLIS)) == 0) {
+    taskENTER_CRITICAL(&_mux);
+    _framer.abort_send();
+    taskEXIT_CRITICAL(&_mux);
+  }
+  return _framer.sent_result();
+}
+
+int PS2Host::read(uint8_t* value, uint32_t timeout_ms, int64_t* received_micros) {
+  if (_rx_queue == nullptr) return -1;
+  RxFrame rx;
+  if (xQueueReceive(_rx_queue, &rx, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+    return -1;
+  }
+  *value = rx.frame & 0xFF;
+  if (received_micros != nullptr) *received_micros = rx.received_micros;
+  return (rx.frame & 0x100) ? -2 : 0;
+}
+
+int PS2Host::command(uint8_t cmd, uint8_t* response, size_t response_len, uint32_t timeout_ms) {
+  for (uint8_t resends = 0;; resends++) {
+    int ret = write(cmd);
+    if (ret != 0) return ret;
+    uint8_t ack;
+    ret = read(&ack, timeout_ms);
+    if (ret != 0) return ret;
+    if (ack == HOST_ACK) break;
+    if (ack != HOST_RESEND || resends == HOST_COMMAND_MAX_RESENDS) return -2;
+  }
+  for (size_t i = 0; i < response_len; i++) {
+    const int ret = read(&response[i], timeout_ms);
+    if (ret != 0) return ret;
+  }
+  return 0;
+}
+
+void PS2Host::flush() {
+  if (_rx_queue != nullptr) xQueueReset(_rx_queue);
+}
+
+void IRAM_ATTR _isr_host_clk_falling(void* arg) { ((PS2Host*)arg)->_on_clk_falling(); }
+
+void IRAM_ATTR PS2Host::_on_clk_falling() {
+  BaseType_t woken = pdFALSE;
+  const int64_t now_micros = esp_timer_get_time();
+  taskENTER_CRITICAL_ISR(&_mux);
+  switch (_framer.on_clk_falling(now_micros)) {
+    case PS2HostFramer<PS2Pins>::Event::RECEIVED: {
+      const RxFrame rx = {_framer.received(), now_micros};
+      xQueueSendFromISR(_rx_queue, &rx, &woken);
+      break;
+    }
+    case PS2HostFramer<PS2Pins>::Event::SENT:
+      if (_tx_task != nullptr) vTaskNotifyGiveFromISR(_tx_task, &woken);
+      break;
+    default:
+      break;
+  }
+  taskEXIT_CRITICAL_ISR(&_mux);
+  portYIELD_FROM_ISR(woken);
+}
+
+}  // namespace esp32_ps2dev
@@ -0,0 +1,61 @@
+#ifndef DD228648_4DEF_42E9_B7F1_5F1ED0B5758B
+#define DD228648_4DEF_42E9_B7F1_5F1ED0B5758B
+
+#include "Arduino.h"
+#include "PS2Gpio.hpp"
+#include "PS2HostFramer.hpp"
+
+namespace esp32_ps2dev {
+
+// A device starts clocking within 15 ms of a request to send and clocks the frame in within 2 ms.
+const uint32_t HOST_SEND_TIMEOUT_MILLIS = 20;
+const UBaseType_t HOST_RX_QUEUE_LENGTH = 16;
+const uint8_t HOST_COMMAND_MAX_RESENDS = 3;
+const uint32_t DEFAULT_HOST_RESPONSE_TIMEOUT_MILLIS = 25;
+
+void _isr_host_clk_falling(void* arg);
+
+// Host side of the bus, to drive a real keyboard or mouse.
+// The device generates the clock in both directions, so every bit is handled by an interrupt on the falling edge of CLK:
+// bytes from the device are queued for read(), and write() waits until the device clocked its byte in and acknowledged it.
+// The bits are handled by PS2HostFramer, which test/test_host_loopback.cpp runs against the frame loops of PS2dev.
+class PS2Host {
+ public:
+  PS2Host(int clk, int data);
+  void begin();
+  // Holds CLK low, so the device keeps its data until release().
+  void inhibit();
+  void release();
+  // Sends a byte to the device. Returns 0 on success, -1 if the device did not clock it in, -2 if it did not acknowledge it.
+  int write(uint8_t value);
+  // Waits for a byte from the device. Returns 0 on success, -1 on timeout, -2 on parity or framing error.
+  // `received_micros` receives the time its frame was complete, from esp_timer_get_time().
+  int read(uint8_t* value, uint32_t timeout_ms = DEFAULT_HOST_RESPONSE_TIMEOUT_MILLIS, int64_t* received_micros = nullptr);
+  // Sends a command and waits for its ACK (0xFA), sending it again when the device answers RESEND (0xFE).
+  // Then reads `response_len` response bytes into `response`. Returns 0 on success, -1 on timeout, -2 on error.
+  int command(uint8_t cmd, uint8_t* response = nullptr, size_t response_len = 0, uint32_t timeout_ms = DEFAULT_HOST_RESPONSE_TIMEOUT_MILLIS);
+  // Discards the bytes received so far.
+  void flush();
+
+ protected:
+  struct RxFrame {
+    uint16_t frame;
+    int64_t received_micros;
+  };
+
+  void _on_clk_falling();
+  int _clk;
+  int _data;
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  PS2HostFramer<PS2Pins> _framer;
+  TaskHandle_t _tx_task = nullptr;
+  QueueHandle_t _rx_queue = nullptr;
+  StaticQueue_t _rx_queue_buffer;
+  uint8_t _rx_queue_storage[HOST_RX_QUEUE_LENGTH * sizeof(RxFrame)];
+
+  friend void _isr_host_clk_falling(void* arg);
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* DD228648_4DEF_42E9_B7F1_5F1ED0B5758B */
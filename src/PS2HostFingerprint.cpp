@@ -0,0 +1,64 @@
+#include "PS2HostFingerprint.hpp"
+
+namespace esp32_ps2dev {
+
+const uint8_t FINGERPRINT_RESET = 0xFF;
+const uint8_t FINGERPRINT_ENABLE_DATA_REPORTING = 0xF4;
+const uint8_t FINGERPRINT_ECHO = 0xEE;
+const uint8_t FINGERPRINT_SET_RESOLUTION = 0xE8;
+const uint8_t FINGERPRINT_STATUS_REQUEST = 0xE9;
+const uint8_t FINGERPRINT_INTELLIMOUSE_SEQUENCE[] = {0xF3, 0xC8, 0xF3, 0x64, 0xF3, 0x50};
+// A BIOS sends little more than a reset, LEDs or typematic rate, and enable.
+const size_t FINGERPRINT_BIOS_MAX_BYTES = 6;
+
+bool PS2HostFingerprint::on_host_byte(uint8_t value) {
+  if (value == FINGERPRINT_RESET) {
+    // a new initialization, possibly by another host behind a KVM or after the BIOS handed over to the OS
+    reset();
+  }
+  if (_classified) return false;
+  if (_len < HOST_FINGERPRINT_BYTES) _bytes[_len++] = value;
+  if (value != FINGERPRINT_ENABLE_DATA_REPORTING && _len < HOST_FINGERPRINT_BYTES) return false;
+  _class = _classify();
+  _classified = true;
+  return true;
+}
+
+void PS2HostFingerprint::reset() {
+  _len = 0;
+  _class = PS2HostClass::UNKNOWN;
+  _classified = false;
+}
+
+PS2HostClass PS2HostFingerprint::_classify() const {
+  for (size_t i = 0; i < _len; i++) {
+    if (_bytes[i] == FINGERPRINT_ECHO) return PS2HostClass::KVM;
+  }
+  if (_has_touchpad_probe()) return PS2HostClass::LINUX;
+  if (_contains(FINGERPRINT_INTELLIMOUSE_SEQUENCE, sizeof(FINGERPRINT_INTELLIMOUSE_SEQUENCE))) return PS2HostClass::WINDOWS;
+  if (_len <= FINGERPRINT_BIOS_MAX_BYTES) return PS2HostClass::BIOS;
+  return PS2HostClass::UNKNOWN;
+}
+
+bool PS2HostFingerprint::_contains(const uint8_t* sequence, size_t len) const {
+  for (size_t i = 0; i + len <= _len; i++) {
+    size_t j = 0;
+    while (j < len && _bytes[i + j] == sequence[j]) j++;
+    if (j == len) return true;
+  }
+  return false;
+}
+
+// E8 xx E8 xx E8 xx E8 xx E9 encodes a query in the resolutions, Synaptics, ALPS and Elantech probes all start so.
+bool PS2HostFingerprint::_has_touchpad_probe() const {
+  for (size_t i = 0; i + 8 < _len; i++) {
+    bool probe = true;
+    for (size_t j = 0; j < 8 && probe; j += 2) {
+      probe = (_bytes[i + j] == FINGERPRINT_SET_RESOLUTION);
+    }
+    if (probe && _bytes[i + 8] == FINGERPRINT_STATUS_REQUEST) return true;
+  }
+  return false;
+}
+
+}  // namespace esp32_ps2dev
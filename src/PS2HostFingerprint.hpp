@@ -0,0 +1,64 @@
+#ifndef B6AE3937_DF6C_4381_84DD_6671F5AF9153
+#define B6AE3937_DF6C_4381_84DD_6671F5AF9153
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace esp32_ps2dev {
+
+enum class PS2HostClass : uint8_t { UNKNOWN, BIOS, LINUX, WINDOWS, KVM };
+const size_t HOST_CLASS_COUNT = 5;
+
+// Timing and behaviour tuned for a class of hosts.
+struct PS2HostPreset {
+  uint32_t clk_half_period_micros;
+  uint32_t byte_interval_micros;
+  // Extra delay between the ACK of a reset and the self-test result.
+  uint32_t bat_delay_millis;
+  // Skips the 200 ms a keyboard waits after a reset, for hosts that do not need it.
+  bool skip_keyboard_reset_delay;
+};
+
+// Indexed by PS2HostClass. Hosts running a full OS driver get the shortest byte interval and no reset delay,
+// firmware that polls the controller (BIOS, KVM switches) keeps the slower timing.
+// All clock periods stay within the PS/2 specification.
+const PS2HostPreset DEFAULT_HOST_PRESETS[HOST_CLASS_COUNT] = {
+    {30, 100, 0, false},  // UNKNOWN, the defaults of PS2dev
+    {40, 150, 0, false},  // BIOS
+    {30, 50, 0, true},    // LINUX
+    {30, 50, 0, true},    // WINDOWS
+    {40, 200, 0, false},  // KVM
+};
+
+// Number of bytes after a reset that are kept to classify the host.
+const size_t HOST_FINGERPRINT_BYTES = 32;
+
+// Classifies the host from the bytes it sends after a reset, commands and arguments alike.
+// The host is classified when it enables data reporting (0xF4), or when the buffer is full:
+// - echo (0xEE) polling: KVM switches check that the device is still there
+// - four SET_RESOLUTION followed by STATUS_REQUEST (E8 xx E8 xx E8 xx E8 xx E9): touchpad probes of Linux psmouse
+// - the IntelliMouse sample rate sequence (F3 C8 F3 64 F3 50) without touchpad probes: Windows
+// - a few bytes only, without the sample rate sequence: BIOS
+// Like PS2TimingCalibrator, it has no dependency on the Arduino core.
+class PS2HostFingerprint {
+ public:
+  // Returns true if the host was classified with this byte.
+  bool on_host_byte(uint8_t value);
+  PS2HostClass host_class() const { return _class; }
+  bool classified() const { return _classified; }
+  void reset();
+
+ protected:
+  PS2HostClass _classify() const;
+  bool _contains(const uint8_t* sequence, size_t len) const;
+  bool _has_touchpad_probe() const;
+
+  uint8_t _bytes[HOST_FINGERPRINT_BYTES];
+  size_t _len = 0;
+  PS2HostClass _class = PS2HostClass::UNKNOWN;
+  bool _classified = false;
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* B6AE3937_DF6C_4381_84DD_6671F5AF9153 */
@@ -0,0 +1,124 @@
+#ifndef B50CC7A1_37F2_428D_A3DC_CA5A20ED5062
+#define B50CC7A1_37F2_428D_A3DC_CA5A20ED5062
+
+#include <esp_attr.h>
+#include <stdint.h>
+
+#include "PS2Frame.hpp"
+
+namespace esp32_ps2dev {
+
+// The host holds CLK low at least this long before it requests to send.
+const uint32_t HOST_INHIBIT_BEFORE_SEND_MICROS = 100;
+// Clock edges further apart than this belong to different frames.
+const uint32_t HOST_BIT_TIMEOUT_MICROS = 500;
+
+// Host side of the frames, driven by the falling edges of CLK. `Pins` is PS2Pins, or a mock on the build machine.
+// It keeps no lock and no queue, PS2Host calls it from its interrupt inside its critical section.
+template <class Pins>
+class PS2HostFramer {
+ public:
+  enum class Mode : uint8_t { RX, INHIBIT, TX };
+  enum class Event : uint8_t { NONE, RECEIVED, SENT };
+
+  explicit PS2HostFramer(const Pins& pins) : _pins(pins) {}
+
+  // Holds CLK low, so the device keeps its data until release().
+  inline void inhibit() {
+    _mode = Mode::INHIBIT;
+    _bit = 0;
+    _pins.clk_low();
+  }
+  inline void release() {
+    _pins.clk_release();
+    _mode = Mode::RX;
+    _bit = 0;
+  }
+  // Requests to send `value`: puts the start bit on DATA and releases CLK, the device then clocks the frame in.
+  // Call it once inhibit() has held CLK low for HOST_INHIBIT_BEFORE_SEND_MICROS.
+  inline void start_send(uint8_t value) {
+    _pins.data_low();
+    // the start bit is on DATA already, the device clocks out the data bits, parity and stop bit
+    _tx_frame = FRAME_TABLE[value] >> 1;
+    _tx_result = -1;
+    _bit = 0;
+    _mode = Mode::TX;
+    _pins.clk_release();
+  }
+  // Gives up a request to send the device did not clock in.
+  inline void abort_send() {
+    _mode = Mode::RX;
+    _bit = 0;
+    _pins.data_release();
+  }
+
+  // The device changes DATA while CLK is high and the host samples it on the falling edge.
+  // When the host sends, it puts the next bit on DATA at each falling edge, and the device samples it on the rising edge.
+  // Returns RECEIVED when a frame from the device is complete, see received(), and SENT when the device clocked
+  // the frame of start_send() in, see sent_result().
+  inline Event IRAM_ATTR on_clk_falling(int64_t now_micros) {
+    const int level = _pins.data_read();
+    Event event = Event::NONE;
+    if (_mode == Mode::TX) {
+      if (_bit < FRAME_BITS - 1) {
+        // data bits, parity, then the stop bit which releases DATA for the ACK
+        if ((_tx_frame >> _bit) & 0x01) {
+          _pins.data_release();
+        } else {
+          _pins.data_low();
+        }
+        _bit++;
+      } else {
+        _tx_result = level ? -2 : 0;
+        _mode = Mode::RX;
+        _bit = 0;
+        event = Event::SENT;
+      }
+    } else if (_mode == Mode::RX) {
+      if (_bit > 0 && now_micros - _last_edge_micros > HOST_BIT_TIMEOUT_MICROS) _bit = 0;
+      if (_bit == 0) {
+        // wait for a start bit
+        if (!level) {
+          _frame = 0;
+          _parity = 1;
+          _bit = 1;
+        }
+      } else if (_bit <= 8) {
+        if (level) {
+          _frame |= 1 << (_bit - 1);
+          _parity ^= 1;
+        }
+        _bit++;
+      } else if (_bit == 9) {
+        if (level != _parity) _frame |= 0x100;
+        _bit++;
+      } else {
+        if (!level) _frame |= 0x100;
+        _bit = 0;
+        event = Event::RECEIVED;
+      }
+      _last_edge_micros = now_micros;
+    }
+    return event;
+  }
+
+  // The last frame received, with bit 8 set on a parity or framing error.
+  inline uint16_t received() const { return _frame; }
+  // Result of the last start_send(): 0 if acknowledged, -1 if not clocked in (yet), -2 if not acknowledged.
+  inline int sent_result() const { return _tx_result; }
+  inline Mode mode() const { return _mode; }
+
+ protected:
+  Pins _pins;
+  volatile Mode _mode = Mode::RX;
+  uint8_t _bit = 0;
+  uint16_t _frame = 0;
+  uint8_t _parity = 1;
+  int64_t _last_edge_micros = 0;
+  uint16_t _tx_frame = 0;
+  volatile int _tx_result = 0;
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* B50CC7A1_37F2_428D_A3DC_CA5A20ED5062 */
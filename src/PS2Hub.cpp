@@ -0,0 +1,100 @@
+#include "PS2Hub.hpp"
+
+#include "Log.hpp"
+#include "PS2TimerEngine.hpp"
+
+namespace esp32_ps2dev {
+
+// 80 MHz APB clock divided by 80 gives 1 microsecond per timer tick.
+const uint16_t HUB_TIMER_DIVIDER = 80;
+
+// Arduino timer callbacks take no argument, so they are dispatched by timer number.
+static PS2Hub* hubs[4] = {};
+
+PS2Hub::PS2Hub(uint8_t timer_num) : _timer_num(timer_num) {}
+
+void PS2Hub::configure(uint32_t clk_half_period_micros) {
+  _clk_half_period_micros = clk_half_period_micros;
+  // the state machine advances every quarter period, four steps per bit
+  _tick_micros = clk_half_period_micros / 2;
+  if (_tick_micros == 0) _tick_micros = 1;
+  if (_timer != nullptr) {
+    timerAlarmWrite(_timer, _tick_micros, true);
+  }
+}
+
+uint32_t PS2Hub::get_clk_half_period_micros() { return _clk_half_period_micros; }
+uint32_t PS2Hub::get_tick_micros() { return _tick_micros; }
+size_t PS2Hub::get_port_count() { return _port_count; }
+
+int PS2Hub::_attach(PS2TimerPort* port) {
+  if (_timer_num >= 4 || _tick_micros == 0) {
+    PS2DEV_LOGE("PS2Hub::_attach: invalid timer or not configured");
+    return -1;
+  }
+  if (_port_count == HUB_MAX_PORTS) {
+    PS2DEV_LOGE("PS2Hub::_attach: no free port");
+    return -1;
+  }
+  if (_timer == nullptr) {
+    hubs[_timer_num] = this;
+    void (*const isrs[4])() = {_isr_timer_0, _isr_timer_1, _isr_timer_2, _isr_timer_3};
+    _timer = timerBegin(_timer_num, HUB_TIMER_DIVIDER, true);
+    if (_timer == nullptr) {
+      PS2DEV_LOGE("PS2Hub::_attach: timerBegin failed");
+      return -1;
+    }
+    timerAttachInterrupt(_timer, isrs[_timer_num], true);
+    timerAlarmWrite(_timer, _tick_micros, true);
+  }
+  // the port is stored before it is counted, so the ISR never sees an empty slot
+  taskENTER_CRITICAL(&_mux);
+  _ports[_port_count] = port;
+  _port_count++;
+  taskEXIT_CRITICAL(&_mux);
+  return 0;
+}
+
+void PS2Hub::_wake() {
+  taskENTER_CRITICAL(&_mux);
+  if (!_running) {
+    _running = true;
+    timerWrite(_timer, 0);
+    timerAlarmEnable(_timer);
+  }
+  taskEXIT_CRITICAL(&_mux);
+}
+
+void IRAM_ATTR PS2Hub::_wake_from_isr() {
+  if (_timer == nullptr) return;
+  taskENTER_CRITICAL_ISR(&_mux);
+  if (!_running) {
+    _running = true;
+    timerWrite(_timer, 0);
+    timerAlarmEnable(_timer);
+  }
+  taskEXIT_CRITICAL_ISR(&_mux);
+}
+
+// Advances every port by one step. The timer is stopped once no port has anything left to do.
+void IRAM_ATTR PS2Hub::_on_timer() {
+  BaseType_t woken = pdFALSE;
+  bool busy = false;
+  taskENTER_CRITICAL_ISR(&_mux);
+  for (size_t i = 0; i < _port_count; i++) {
+    if (PS2TimerEngine::_step(*_ports[i], &woken)) busy = true;
+  }
+  if (!busy) {
+    _running = false;
+    timerAlarmDisable(_timer);
+  }
+  taskEXIT_CRITICAL_ISR(&_mux);
+  portYIELD_FROM_ISR(woken);
+}
+
+void IRAM_ATTR PS2Hub::_isr_timer_0() { hubs[0]->_on_timer(); }
+void IRAM_ATTR PS2Hub::_isr_timer_1() { hubs[1]->_on_timer(); }
+void IRAM_ATTR PS2Hub::_isr_timer_2() { hubs[2]->_on_timer(); }
+void IRAM_ATTR PS2Hub::_isr_timer_3() { hubs[3]->_on_timer(); }
+
+}  // namespace esp32_ps2dev
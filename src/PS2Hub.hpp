@@ -0,0 +1,53 @@
+#ifndef FD8C48A5_EA82_4AA2_BF32_A8767FB83ED9
+#define FD8C48A5_EA82_4AA2_BF32_A8767FB83ED9
+
+#include "Arduino.h"
+
+namespace esp32_ps2dev {
+
+const uint8_t DEFAULT_TIMER_ENGINE_TIMER_NUM = 0;
+const size_t HUB_MAX_PORTS = 8;
+
+struct PS2TimerPort;
+
+// One hardware timer shared by the ports of several PS2TimerEngine instances.
+// Every tick advances each port by one step in the same interrupt, so the edges of all ports are interleaved
+// in a single timing context, and adding a port costs one step per tick instead of a timer, a task and a critical section.
+// All ports share the clock period of the hub.
+//
+//   esp32_ps2dev::PS2Hub hub(0);  // hardware timer number
+//   esp32_ps2dev::PS2TimerEngine keyboard_engine(hub), mouse_engine(hub);
+class PS2Hub {
+ public:
+  PS2Hub(uint8_t timer_num = DEFAULT_TIMER_ENGINE_TIMER_NUM);
+  // Must be called before the first port begins, and only while no frame is in flight.
+  void configure(uint32_t clk_half_period_micros);
+  uint32_t get_clk_half_period_micros();
+  uint32_t get_tick_micros();
+  size_t get_port_count();
+
+ protected:
+  // Called by PS2TimerEngine::begin(). Starts the timer with the first port. Returns 0 on success, -1 on failure.
+  int _attach(PS2TimerPort* port);
+  void _wake();
+  void _wake_from_isr();
+  void _on_timer();
+  static void _isr_timer_0();
+  static void _isr_timer_1();
+  static void _isr_timer_2();
+  static void _isr_timer_3();
+  uint8_t _timer_num;
+  hw_timer_t* _timer = nullptr;
+  uint32_t _clk_half_period_micros = 0;
+  uint32_t _tick_micros = 0;
+  volatile bool _running = false;
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  PS2TimerPort* _ports[HUB_MAX_PORTS] = {};
+  size_t _port_count = 0;
+
+  friend class PS2TimerEngine;
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* FD8C48A5_EA82_4AA2_BF32_A8767FB83ED9 */
@@ -2,6 +2,8 @@
 
 namespace esp32_ps2dev {
 
+const uint32_t KEYBOARD_RESET_DELAY_MILLIS = 200;
+
 PS2Keyboard::PS2Keyboard(int clk, int data) : PS2dev(clk, data) {}
 void PS2Keyboard::begin(bool restore_internal_state) {
   PS2dev::begin();
@@ -34,13 +36,13 @@ bool PS2Keyboard::is_num_lock_led_on() { return _led_num_lock; }
 bool PS2Keyboard::is_caps_lock_led_on() { return _led_caps_lock; }
 
 int PS2Keyboard::reply_to_host(uint8_t host_cmd) {
-  uint8_t val;
   switch ((Command)host_cmd) {
     case Command::RESET:  // reset
       PS2DEV_LOGD("PS2Keyboard::reply_to_host: Reset command received");
       // the while loop lets us wait for the host to be ready
       ack();       // ack() provides delay, some systems need it
-      delay(200);  // emulate keyboard reset delay
+      // emulate keyboard reset delay
+      delay((_skip_keyboard_reset_delay ? 0 : KEYBOARD_RESET_DELAY_MILLIS) + _bat_delay_millis);
       while (write((uint8_t)Command::BAT_SUCCESS) != 0) delay(1);
       _data_reporting_enabled = true;
       _led_scroll_lock = false;
@@ -65,12 +67,15 @@ int PS2Keyboard::reply_to_host(uint8_t host_cmd) {
       PS2DEV_LOGD("PS2Keyboard::reply_to_host: Enable data reporting command received");
       _data_reporting_enabled = true;
       ack();
+      if (_replay_pending) {
+        _replay_pending = false;
+        _replay_held_keys();
+      }
       break;
     case Command::SET_TYPEMATIC_RATE:  // set typematic rate
       PS2DEV_LOGD("PS2Keyboard::reply_to_host: Set typematic rate command received");
       ack();
-      if (!read(&val)) ack();  // do nothing with the rate
-      break;
+      return HOST_COMMAND_AWAIT_ARGUMENT;
     case Command::GET_DEVICE_ID:  // get device id
       PS2DEV_LOGD("PS2Keyboard::reply_to_host: Get device id command received");
       ack();
@@ -80,8 +85,7 @@ int PS2Keyboard::reply_to_host(uint8_t host_cmd) {
     case Command::SET_SCAN_CODE_SET:  // set scan code set
       PS2DEV_LOGD("PS2Keyboard::reply_to_host: Set scan code set command received");
       ack();
-      if (!read(&val)) ack();  // do nothing with the rate
-      break;
+      return HOST_COMMAND_AWAIT_ARGUMENT;
     case Command::ECHO:  // echo
       PS2DEV_LOGD("PS2Keyboard::reply_to_host: Echo command received");
       delayMicroseconds(_config_byte_interval_micros);
@@ -91,14 +95,7 @@ int PS2Keyboard::reply_to_host(uint8_t host_cmd) {
     case Command::SET_RESET_LEDS:  // set/reset LEDs
       PS2DEV_LOGD("PS2Keyboard::reply_to_host: Set/reset LEDs command received");
       while (write(0xAF) != 0) delay(1);
-      if (!read(&val)) {
-        while (write(0xAF) != 0) delay(1);
-        _led_scroll_lock = ((val & 1) != 0);
-        _led_num_lock = ((val & 2) != 0);
-        _led_caps_lock = ((val & 4) != 0);
-      }
-      return 1;
-      break;
+      return HOST_COMMAND_AWAIT_ARGUMENT;
     default:
       PS2DEV_LOGD(std::string("PS2Keyboard::reply_to_host: Unknown command received: ") + String(host_cmd, HEX).c_str());
       break;
@@ -107,24 +104,51 @@ int PS2Keyboard::reply_to_host(uint8_t host_cmd) {
   return 0;
 }
 
-void PS2Keyboard::keydown(scancodes::Key key) {
-  if (!_data_reporting_enabled) return;
+int PS2Keyboard::reply_to_host_argument(uint8_t host_cmd, uint8_t val) {
+  // the host sent a new command instead of the argument
+  if (val >= (uint8_t)Command::SET_RESET_LEDS) return -1;
+
+  switch ((Command)host_cmd) {
+    case Command::SET_TYPEMATIC_RATE:
+      ack();  // do nothing with the rate
+      break;
+    case Command::SET_SCAN_CODE_SET:
+      ack();  // do nothing with the scan code set
+      break;
+    case Command::SET_RESET_LEDS:
+      while (write(0xAF) != 0) delay(1);
+      _led_scroll_lock = ((val & 1) != 0);
+      _led_num_lock = ((val & 2) != 0);
+      _led_caps_lock = ((val & 4) != 0);
+      break;
+    default:
+      return -1;
+  }
+  return 0;
+}
+
+int PS2Keyboard::keydown(scancodes::Key key, TickType_t ticks_to_wait) {
+  _set_held(key, true);
+  if (!_data_reporting_enabled) return 0;
   PS2Packet packet;
   packet.len = scancodes::MAKE_CODES_LEN[key];
   for (uint8_t i = 0; i < packet.len; i++) {
     packet.data[i] = scancodes::MAKE_CODES[key][i];
   }
-  send_packet_to_queue(packet);
+  packet.kind = PS2PacketKind::KEY;
+  return send_packet_to_queue(packet, ticks_to_wait);
 }
 
-void PS2Keyboard::keyup(scancodes::Key key) {
-  if (!_data_reporting_enabled) return;
+int PS2Keyboard::keyup(scancodes::Key key, TickType_t ticks_to_wait) {
+  _set_held(key, false);
+  if (!_data_reporting_enabled) return 0;
   PS2Packet packet;
   packet.len = scancodes::BREAK_CODES_LEN[key];
   for (uint8_t i = 0; i < packet.len; i++) {
     packet.data[i] = scancodes::BREAK_CODES[key][i];
   }
-  send_packet_to_queue(packet);
+  packet.kind = PS2PacketKind::KEY;
+  return send_packet_to_queue(packet, ticks_to_wait);
 }
 
 void PS2Keyboard::type(scancodes::Key key) {
@@ -495,14 +519,54 @@ void PS2Keyboard::type(const char* str) {
   }
 }
 
-void PS2Keyboard::send_scancode(const std::vector<uint8_t>& scancode) {
-  if (!_data_reporting_enabled) return;
+int PS2Keyboard::send_scancode(const std::vector<uint8_t>& scancode, TickType_t ticks_to_wait) {
+  if (!_data_reporting_enabled) return 0;
   PS2Packet packet;
   packet.len = scancode.size();
   for (uint8_t i = 0; i < packet.len; i++) {
     packet.data[i] = scancode[i];
   }
-  send_packet_to_queue(packet);
+  packet.kind = PS2PacketKind::KEY;
+  return send_packet_to_queue(packet, ticks_to_wait);
+}
+
+// The host was off or unplugged and will initialize the keyboard again, so start over as after power-up.
+// The LEDs are the host's to set again, while the keys still held are replayed once the host enables data reporting.
+void PS2Keyboard::_on_host_reconnected() {
+  _data_reporting_enabled = true;
+  _led_scroll_lock = false;
+  _led_num_lock = false;
+  _led_caps_lock = false;
+  _replay_pending = true;
+  if (_bat_delay_millis > 0) delay(_bat_delay_millis);
+  PS2Packet packet;
+  packet.len = 1;
+  packet.data[0] = (uint8_t)Command::BAT_SUCCESS;
+  send_response_to_queue(packet);
+}
+
+// Keys without a break code, such as Pause, are never held.
+void PS2Keyboard::_set_held(scancodes::Key key, bool held) {
+  if ((size_t)key >= KEYBOARD_KEY_COUNT || scancodes::BREAK_CODES_LEN[key] == 0) return;
+  if (held) {
+    _held_keys[key / 32] |= 1UL << (key % 32);
+  } else {
+    _held_keys[key / 32] &= ~(1UL << (key % 32));
+  }
+}
+
+// Sends the make codes of the keys pressed by keydown() and not released yet.
+void PS2Keyboard::_replay_held_keys() {
+  for (size_t key = 0; key < KEYBOARD_KEY_COUNT; key++) {
+    if (!(_held_keys[key / 32] & (1UL << (key % 32)))) continue;
+    PS2Packet packet;
+    packet.len = scancodes::MAKE_CODES_LEN[key];
+    for (uint8_t i = 0; i < packet.len; i++) {
+      packet.data[i] = scancodes::MAKE_CODES[key][i];
+    }
+    packet.kind = PS2PacketKind::KEY;
+    send_packet_to_queue(packet);
+  }
 }
 
 void PS2Keyboard::_save_internal_state_to_nvs() {
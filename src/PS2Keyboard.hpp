@@ -10,10 +10,13 @@
 
 namespace esp32_ps2dev {
 
+const size_t KEYBOARD_KEY_COUNT = sizeof(scancodes::MAKE_CODES_LEN);
+
 class PS2Keyboard : public PS2dev {
  public:
   PS2Keyboard(int clk, int data);
   int reply_to_host(uint8_t host_cmd);
+  int reply_to_host_argument(uint8_t host_cmd, uint8_t arg);
   enum class Command {
     RESET = 0xFF,
     RESEND = 0xFE,
@@ -33,14 +36,17 @@ class PS2Keyboard : public PS2dev {
   bool is_scroll_lock_led_on();
   bool is_num_lock_led_on();
   bool is_caps_lock_led_on();
-  void keydown(scancodes::Key key);
-  void keyup(scancodes::Key key);
+  int keydown(scancodes::Key key, TickType_t ticks_to_wait = 0);
+  int keyup(scancodes::Key key, TickType_t ticks_to_wait = 0);
   void type(scancodes::Key key);
   void type(std::initializer_list<scancodes::Key> keys);
   void type(const char* str);
-  void send_scancode(const std::vector<uint8_t>& scancode);
+  int send_scancode(const std::vector<uint8_t>& scancode, TickType_t ticks_to_wait = 0);
 
  protected:
+  void _on_host_reconnected();
+  void _set_held(scancodes::Key key, bool held);
+  void _replay_held_keys();
   void _save_internal_state_to_nvs();
   void _load_internal_state_from_nvs();
   nvs_handle _nvs_handle;
@@ -48,6 +54,8 @@ class PS2Keyboard : public PS2dev {
   bool _led_scroll_lock = false;
   bool _led_num_lock = false;
   bool _led_caps_lock = false;
+  uint32_t _held_keys[(KEYBOARD_KEY_COUNT + 31) / 32] = {};
+  bool _replay_pending = false;
 };
 
 }  // namespace esp32_ps2dev
@@ -0,0 +1,43 @@
+#include "PS2KeyboardGroup.hpp"
+
+namespace esp32_ps2dev {
+
+PS2KeyboardGroup::PS2KeyboardGroup() : PS2DevGroup(PS2PacketKind::KEY, false) {}
+
+int PS2KeyboardGroup::add(PS2Keyboard& keyboard) {
+  const size_t index = _count;
+  if (_add(keyboard) != 0) return -1;
+  _keyboards[index] = &keyboard;
+  return 0;
+}
+
+size_t PS2KeyboardGroup::keydown(scancodes::Key key, TickType_t ticks_to_wait) {
+  return send_scancode(scancodes::MAKE_CODES[key], scancodes::MAKE_CODES_LEN[key], ticks_to_wait);
+}
+
+size_t PS2KeyboardGroup::keyup(scancodes::Key key, TickType_t ticks_to_wait) {
+  return send_scancode(scancodes::BREAK_CODES[key], scancodes::BREAK_CODES_LEN[key], ticks_to_wait);
+}
+
+size_t PS2KeyboardGroup::send_scancode(const uint8_t* scancode, size_t len, TickType_t ticks_to_wait) {
+  PS2Packet packet;
+  if (len > sizeof(packet.data)) return 0;
+  packet.len = len;
+  for (uint8_t i = 0; i < packet.len; i++) {
+    packet.data[i] = scancode[i];
+  }
+  packet.kind = PS2PacketKind::KEY;
+  const PS2Packet* packets[DEV_GROUP_MAX_PORTS];
+  for (size_t i = 0; i < _count; i++) {
+    packets[i] = _keyboards[i]->data_reporting_enabled() ? &packet : nullptr;
+  }
+  return _dispatch(packets, false, ticks_to_wait);
+}
+
+void PS2KeyboardGroup::type(scancodes::Key key) {
+  keydown(key);
+  delay(10);
+  keyup(key);
+}
+
+}  // namespace esp32_ps2dev
@@ -0,0 +1,29 @@
+#ifndef D838B85D_AC37_40CE_A724_9719FCD14148
+#define D838B85D_AC37_40CE_A724_9719FCD14148
+
+#include "PS2DevGroup.hpp"
+#include "PS2Keyboard.hpp"
+
+namespace esp32_ps2dev {
+
+// Fans one stream of key events out to several hosts, one PS2Keyboard per host.
+// Each scancode is encoded once and queued on every port back to back, see PS2DevGroup.
+// Late hosts are only counted, never skipped, as a lost break code would leave the key held on that host.
+class PS2KeyboardGroup : public PS2DevGroup {
+ public:
+  PS2KeyboardGroup();
+  // Takes over the packet completion callback of `keyboard`. Returns 0 on success, -1 if the group is full.
+  int add(PS2Keyboard& keyboard);
+  // Return the number of hosts the scancode was queued for. Hosts with data reporting disabled are skipped.
+  size_t keydown(scancodes::Key key, TickType_t ticks_to_wait = 0);
+  size_t keyup(scancodes::Key key, TickType_t ticks_to_wait = 0);
+  size_t send_scancode(const uint8_t* scancode, size_t len, TickType_t ticks_to_wait = 0);
+  void type(scancodes::Key key);
+
+ protected:
+  PS2Keyboard* _keyboards[DEV_GROUP_MAX_PORTS] = {};
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* D838B85D_AC37_40CE_A724_9719FCD14148 */
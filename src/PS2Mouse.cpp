@@ -4,7 +4,9 @@ namespace esp32_ps2dev {
 
 const uint32_t MOUSE_CLICK_PRESSING_DURATION_MILLIS = 100;
 
-PS2Mouse::PS2Mouse(int clk, int data) : PS2dev(clk, data) {}
+PS2Mouse::PS2Mouse(int clk, int data) : PS2dev(clk, data) {
+  _packet_queue.set_merger([this](PS2Packet& newest, const PS2Packet& packet) { return _merge_packets(newest, packet); });
+}
 void PS2Mouse::begin(bool restore_internal_state) {
   PS2dev::begin();
 
@@ -28,12 +30,20 @@ void PS2Mouse::begin(bool restore_internal_state) {
     _load_internal_state_from_nvs();
   }
 
-  xTaskCreateUniversal(_taskfn_poll_mouse_count, "PS2Mouse", 4096, this, _config_task_priority - 1, &_task_poll_mouse_count,
-                       _config_task_core);
+  if (_config_merged_task) {
+    // counts are polled by the merged task through _poll()
+    _task_poll_mouse_count = _task_process_host_request;
+  } else {
+    xTaskCreateUniversal(_taskfn_poll_mouse_count, "PS2Mouse", _config_task_stack_size, this, _config_task_priority - 1, &_task_poll_mouse_count,
+                         _config_task_core);
+  }
+}
+
+UBaseType_t PS2Mouse::get_poll_task_stack_high_water_mark() {
+  return (_task_poll_mouse_count != nullptr) ? uxTaskGetStackHighWaterMark(_task_poll_mouse_count) : 0;
 }
 
 int PS2Mouse::reply_to_host(uint8_t host_cmd) {
-  uint8_t val;
   if (_mode == Mode::WRAP_MODE) {
     switch ((Command)host_cmd) {
       case Command::SET_WRAP_MODE:  // set wrap mode
@@ -58,20 +68,13 @@ int PS2Mouse::reply_to_host(uint8_t host_cmd) {
     case Command::RESET:  // reset
       PS2DEV_LOGD("PS2Mouse::reply_to_host: Reset command received");
       ack();
+      if (_bat_delay_millis > 0) delay(_bat_delay_millis);
       // the while loop lets us wait for the host to be ready
       while (write(0xAA) != 0) delay(1);
       delayMicroseconds(_config_byte_interval_micros);
       while (write(0x00) != 0) delay(1);
       delayMicroseconds(_config_byte_interval_micros);
-      _has_wheel = false;
-      _has_4th_and_5th_buttons = false;
-      _sample_rate = 100;
-      _resolution = ResolutionCode::RES_4;
-      _scale = Scale::ONE_ONE;
-      _data_reporting_enabled = false;
-      _mode = Mode::STREAM_MODE;
-      _save_internal_state_to_nvs();
-      reset_counter();
+      _reset_internal_state();
       break;
     case Command::RESEND:  // resend
       PS2DEV_LOGD("PS2Mouse::reply_to_host: Resend command received");
@@ -102,34 +105,18 @@ int PS2Mouse::reply_to_host(uint8_t host_cmd) {
       _data_reporting_enabled = true;
       _save_internal_state_to_nvs();
       reset_counter();
-      break;
-    case Command::SET_SAMPLE_RATE:  // set sample rate
-      ack();
-      if (read(&val) == 0) {
-        switch (val) {
-          case 10:
-          case 20:
-          case 40:
-          case 60:
-          case 80:
-          case 100:
-          case 200:
-            _sample_rate = val;
-            _last_sample_rate[0] = _last_sample_rate[1];
-            _last_sample_rate[1] = _last_sample_rate[2];
-            _last_sample_rate[2] = val;
-            PS2DEV_LOGD(std::string("Set sample rate command received: ") + String(val).c_str());
-            ack();
-            break;
-
-          default:
-            break;
+      if (_replay_pending) {
+        _replay_pending = false;
+        if (_button_left || _button_right || _button_middle || _button_4th || _button_5th) {
+          // the next report carries the buttons held while the host was away
+          _count_or_button_changed = true;
+          _wake_poll();
         }
-        _save_internal_state_to_nvs();
-        // _min_report_interval_us = 1000000 / sample_rate;
-        reset_counter();
       }
       break;
+    case Command::SET_SAMPLE_RATE:  // set sample rate
+      ack();
+      return HOST_COMMAND_AWAIT_ARGUMENT;
     case Command::GET_DEVICE_ID:  // get device id
       PS2DEV_LOGD("PS2Mouse::reply_to_host: Get device id command received");
       ack();
@@ -177,7 +164,7 @@ int PS2Mouse::reply_to_host(uint8_t host_cmd) {
       break;
     case Command::READ_DATA:  // read data
       ack();
-      send_packet_to_queue(get_packet());
+      send_response_to_queue(get_packet());
       reset_counter();
       break;
     case Command::SET_STREAM_MODE:  // set stream mode
@@ -192,14 +179,7 @@ int PS2Mouse::reply_to_host(uint8_t host_cmd) {
       break;
     case Command::SET_RESOLUTION:  // set resolution
       ack();
-      if (read(&val) == 0 && val <= 3) {
-        _resolution = (ResolutionCode)val;
-        PS2DEV_LOGD(std::string("PS2Mouse::reply_to_host: Set resolution command received: ") + String(val, HEX).c_str());
-        ack();
-        _save_internal_state_to_nvs();
-        reset_counter();
-      }
-      break;
+      return HOST_COMMAND_AWAIT_ARGUMENT;
     case Command::SET_SCALING_2_1:  // set scaling 2:1
       PS2DEV_LOGD("PS2Mouse::reply_to_host: Set scaling 2:1 command received");
       ack();
@@ -219,6 +199,50 @@ int PS2Mouse::reply_to_host(uint8_t host_cmd) {
   return 0;
 }
 
+int PS2Mouse::reply_to_host_argument(uint8_t host_cmd, uint8_t val) {
+  // the host sent a new command instead of the argument
+  if (val >= (uint8_t)Command::SET_SCALING_1_1) return -1;
+
+  switch ((Command)host_cmd) {
+    case Command::SET_SAMPLE_RATE:
+      switch (val) {
+        case 10:
+        case 20:
+        case 40:
+        case 60:
+        case 80:
+        case 100:
+        case 200:
+          _sample_rate = val;
+          _last_sample_rate[0] = _last_sample_rate[1];
+          _last_sample_rate[1] = _last_sample_rate[2];
+          _last_sample_rate[2] = val;
+          PS2DEV_LOGD(std::string("Set sample rate command received: ") + String(val).c_str());
+          ack();
+          break;
+
+        default:
+          break;
+      }
+      _save_internal_state_to_nvs();
+      // _min_report_interval_us = 1000000 / sample_rate;
+      reset_counter();
+      break;
+    case Command::SET_RESOLUTION:
+      if (val <= 3) {
+        _resolution = (ResolutionCode)val;
+        PS2DEV_LOGD(std::string("PS2Mouse::reply_to_host_argument: Set resolution command received: ") + String(val, HEX).c_str());
+        ack();
+        _save_internal_state_to_nvs();
+        reset_counter();
+      }
+      break;
+    default:
+      return -1;
+  }
+  return 0;
+}
+
 bool PS2Mouse::has_wheel() { return _has_wheel; }
 bool PS2Mouse::has_4th_and_5th_buttons() { return _has_4th_and_5th_buttons; }
 bool PS2Mouse::data_reporting_enabled() { return _data_reporting_enabled; }
@@ -233,11 +257,13 @@ void PS2Mouse::reset_counter() {
 }
 
 uint8_t PS2Mouse::get_sample_rate() { return _sample_rate; }
+PS2Mouse::Scale PS2Mouse::get_scale() { return _scale; }
 void PS2Mouse::move(int16_t x, int16_t y, int8_t wheel) {
   _count_x += x;
   _count_y += y;
   _count_z += wheel;
   _count_or_button_changed = true;
+  _wake_poll();
 }
 
 void PS2Mouse::press(Button button) {
@@ -261,6 +287,7 @@ void PS2Mouse::press(Button button) {
       break;
   }
   _count_or_button_changed = true;
+  _wake_poll();
 }
 
 void PS2Mouse::release(Button button) {
@@ -284,6 +311,7 @@ void PS2Mouse::release(Button button) {
       break;
   }
   _count_or_button_changed = true;
+  _wake_poll();
 }
 
 void PS2Mouse::click(Button button) {
@@ -302,6 +330,12 @@ void PS2Mouse::move_and_buttons(int16_t x, int16_t y, int8_t wheel, bool left, b
   _button_4th = button_4 ? 1 : 0;
   _button_5th = button_5 ? 1 : 0;
   _count_or_button_changed = true;
+  _wake_poll();
+}
+
+// In idle mode the task polling the counts sleeps until there is input.
+void PS2Mouse::_wake_poll() {
+  if (_config_idle_mode && _task_poll_mouse_count != nullptr) xTaskNotifyGive(_task_poll_mouse_count);
 }
 
 bool PS2Mouse::is_count_or_button_changed() { return _count_or_button_changed; }
@@ -387,20 +421,69 @@ PS2Packet PS2Mouse::make_packet(int16_t x, int16_t y, int8_t wheel, bool left, b
   } else {
     packet.len = 3;
   }
+  packet.kind = PS2PacketKind::MOTION;
   return packet;
 }
 
+// Adds the movement of `packet` to `newest`, a report still in the queue, for PS2OverflowPolicy::MERGE_MOTION.
+// Reports with different buttons are not merged, so that no click is lost.
+bool PS2Mouse::_merge_packets(PS2Packet& newest, const PS2Packet& packet) {
+  if (newest.len != packet.len || (newest.data[0] & 0x07) != (packet.data[0] & 0x07)) return false;
+  const bool has_4th_and_5th_buttons = (packet.len == 4 && _has_4th_and_5th_buttons);
+  if (has_4th_and_5th_buttons && (newest.data[3] & 0x30) != (packet.data[3] & 0x30)) return false;
+
+  // movements are 9-bit two's complement, the sign bits are in the first byte
+  int16_t x = (int16_t)(newest.data[1] | ((newest.data[0] & 0x10) ? 0xFF00 : 0)) + (int16_t)(packet.data[1] | ((packet.data[0] & 0x10) ? 0xFF00 : 0));
+  int16_t y = (int16_t)(newest.data[2] | ((newest.data[0] & 0x20) ? 0xFF00 : 0)) + (int16_t)(packet.data[2] | ((packet.data[0] & 0x20) ? 0xFF00 : 0));
+  uint8_t x_overflow = ((newest.data[0] | packet.data[0]) >> 6) & 1;
+  uint8_t y_overflow = ((newest.data[0] | packet.data[0]) >> 7) & 1;
+  if (x > 255 || x < -255) {
+    x_overflow = 1;
+    x = (x > 0) ? 255 : -255;
+  }
+  if (y > 255 || y < -255) {
+    y_overflow = 1;
+    y = (y > 0) ? 255 : -255;
+  }
+  newest.data[0] = (packet.data[0] & 0x07) | (1 << 3) | ((x < 0) << 4) | ((y < 0) << 5) | (x_overflow << 6) | (y_overflow << 7);
+  newest.data[1] = x & 0xFF;
+  newest.data[2] = y & 0xFF;
+
+  if (packet.len == 4) {
+    int16_t wheel;
+    if (has_4th_and_5th_buttons) {
+      wheel = (int8_t)(newest.data[3] << 4) / 16 + (int8_t)(packet.data[3] << 4) / 16;
+    } else {
+      wheel = (int8_t)newest.data[3] + (int8_t)packet.data[3];
+    }
+    if (wheel > 7) {
+      wheel = 7;
+    } else if (wheel < -8) {
+      wheel = -8;
+    }
+    if (has_4th_and_5th_buttons) {
+      newest.data[3] = (wheel & 0x0F) | (packet.data[3] & 0x30);
+    } else {
+      newest.data[3] = wheel & 0xFF;
+    }
+  }
+  return true;
+}
+
 PS2Packet PS2Mouse::get_packet() {
   return make_packet(_count_x, _count_y, _count_z, _button_left, _button_right, _button_middle, _button_4th, _button_5th);
 }
 
 // Send a report to the host immediately.
 // Use with care, this function ignore the sample rate specified by the host.
-void IRAM_ATTR PS2Mouse::send_report(int16_t x, int16_t y, int8_t wheel, bool left, bool right, bool middle, bool button_4, bool button_5) {
+// Returns 0 if the report was queued or reporting is disabled, -1 if the queue rejected it.
+int IRAM_ATTR PS2Mouse::send_report(int16_t x, int16_t y, int8_t wheel, bool left, bool right, bool middle, bool button_4, bool button_5,
+                                    TickType_t ticks_to_wait) {
   PS2Packet packet = make_packet(x, y, wheel, left, right, middle, button_4, button_5);
   if (_data_reporting_enabled) {
-    send_packet_to_queue(packet);
+    return send_packet_to_queue(packet, ticks_to_wait);
   }
+  return 0;
 }
 
 void PS2Mouse::_save_internal_state_to_nvs() {
@@ -465,19 +548,68 @@ void PS2Mouse::_send_status() {
                    (((uint8_t)_scale & 1) << 4) & ((_data_reporting_enabled & 1) << 5) & ((mode & 1) << 6) & ((0) << 7);
   packet.data[1] = (uint8_t)_resolution;
   packet.data[2] = _sample_rate;
-  send_packet_to_queue(packet);
+  send_response_to_queue(packet);
+}
+
+// Power-on state, as after a reset command.
+void PS2Mouse::_reset_internal_state() {
+  _has_wheel = false;
+  _has_4th_and_5th_buttons = false;
+  _sample_rate = 100;
+  _resolution = ResolutionCode::RES_4;
+  _scale = Scale::ONE_ONE;
+  _data_reporting_enabled = false;
+  _mode = Mode::STREAM_MODE;
+  _save_internal_state_to_nvs();
+  reset_counter();
+}
+
+// The host was off or unplugged and will initialize the mouse again, so start over as after power-up.
+// The mode, rate and resolution are the host's to negotiate again, while the buttons still held are replayed
+// once the host enables data reporting.
+void PS2Mouse::_on_host_reconnected() {
+  _reset_internal_state();
+  _replay_pending = true;
+  if (_bat_delay_millis > 0) delay(_bat_delay_millis);
+  PS2Packet packet;
+  packet.len = 2;
+  packet.data[0] = 0xAA;
+  packet.data[1] = 0x00;
+  send_response_to_queue(packet);
+  // polling stopped while the host was away
+  if (_task_poll_mouse_count != nullptr) xTaskNotifyGive(_task_poll_mouse_count);
+}
+
+// Sends the counts accumulated since the last call. Returns the milliseconds until the next report is due,
+// or 0 to wait for input in idle mode when there was nothing to send, and for the host while it is absent.
+uint32_t PS2Mouse::_poll() {
+  if (_host_presence == PS2HostPresence::ABSENT) {
+    // counts made while the host is away are meaningless to it
+    reset_counter();
+    return 0;
+  }
+  const bool changed = is_count_or_button_changed();
+  if (data_reporting_enabled() && changed) {
+    send_packet_to_queue(get_packet());
+  }
+  reset_counter();
+  // the next report waits for the sample period even in idle mode
+  return (_config_idle_mode && !changed) ? 0 : 1000 / get_sample_rate();
 }
 
 void _taskfn_poll_mouse_count(void* arg) {
   PS2Mouse* ps2mouse = (PS2Mouse*)arg;
   while (true) {
-    if (ps2mouse->data_reporting_enabled() && ps2mouse->is_count_or_button_changed()) {
-      ps2mouse->send_packet_to_queue(ps2mouse->get_packet());
+    const int64_t woken_micros = ps2mouse->_on_task_woken();
+    const uint32_t interval_millis = ps2mouse->_poll();
+    ps2mouse->_on_task_waiting(woken_micros);
+    if (interval_millis == 0) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    } else {
+      delay(interval_millis);
     }
-    ps2mouse->reset_counter();
-    delay(1000 / ps2mouse->get_sample_rate());
   }
   vTaskDelete(NULL);
 }
 
-}  // namespace esp32_ps2dev
\ No newline at end of file
+}  // namespace esp32_ps2dev
@@ -7,6 +7,8 @@
 
 namespace esp32_ps2dev {
 
+void _taskfn_poll_mouse_count(void* arg);
+
 class PS2Mouse : public PS2dev {
  public:
   PS2Mouse(int clk, int data);
@@ -44,11 +46,13 @@ class PS2Mouse : public PS2dev {
 
   void begin(bool restore_internal_state = false);
   int reply_to_host(uint8_t host_cmd);
+  int reply_to_host_argument(uint8_t host_cmd, uint8_t arg);
   bool has_wheel();
   bool has_4th_and_5th_buttons();
   bool data_reporting_enabled();
   void reset_counter();
   uint8_t get_sample_rate();
+  Scale get_scale();
   void move(int16_t x, int16_t y, int8_t wheel);
   void press(Button button);
   void release(Button button);
@@ -57,13 +61,20 @@ class PS2Mouse : public PS2dev {
   bool is_count_or_button_changed();
   PS2Packet make_packet(int16_t x, int16_t y, int8_t wheel, bool left, bool right, bool middle, bool button_4, bool button_5);
   PS2Packet get_packet();
-  void send_report(int16_t x, int16_t y, int8_t wheel, bool left, bool right, bool middle, bool button_4, bool button_5);
+  int send_report(int16_t x, int16_t y, int8_t wheel, bool left, bool right, bool middle, bool button_4, bool button_5,
+                  TickType_t ticks_to_wait = 0);
+  UBaseType_t get_poll_task_stack_high_water_mark();
 
  protected:
+  uint32_t _poll();
+  void _reset_internal_state();
+  void _wake_poll();
+  void _on_host_reconnected();
+  bool _merge_packets(PS2Packet& newest, const PS2Packet& packet);
   void _send_status();
   void _save_internal_state_to_nvs();
   void _load_internal_state_from_nvs();
-  TaskHandle_t _task_poll_mouse_count;
+  TaskHandle_t _task_poll_mouse_count = nullptr;
   nvs_handle _nvs_handle;
   bool _has_wheel = false;
   bool _has_4th_and_5th_buttons = false;
@@ -85,9 +96,10 @@ class PS2Mouse : public PS2dev {
   uint8_t _button_4th = 0;
   uint8_t _button_5th = 0;
   bool _count_or_button_changed = false;
-};
+  bool _replay_pending = false;
 
-void _taskfn_poll_mouse_count(void* arg);
+  friend void _taskfn_poll_mouse_count(void* arg);
+};
 
 }  // namespace esp32_ps2dev
 
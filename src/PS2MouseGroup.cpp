@@ -0,0 +1,52 @@
+#include "PS2MouseGroup.hpp"
+
+namespace esp32_ps2dev {
+
+PS2MouseGroup::PS2MouseGroup() : PS2DevGroup(PS2PacketKind::MOTION, true) {}
+
+int PS2MouseGroup::add(PS2Mouse& mouse) {
+  const size_t index = _count;
+  if (_add(mouse) != 0) return -1;
+  _mice[index] = &mouse;
+  return 0;
+}
+
+size_t PS2MouseGroup::send_report(int16_t x, int16_t y, int8_t wheel, bool left, bool right, bool middle, bool button_4, bool button_5,
+                                  TickType_t ticks_to_wait) {
+  // one packet per variant: bit 0 wheel, bit 1 4th and 5th buttons, bit 2 scaling 2:1
+  PS2Packet packets[8];
+  bool encoded[8] = {};
+  const PS2Packet* port_packets[MOUSE_GROUP_MAX_PORTS];
+  for (size_t i = 0; i < _count; i++) {
+    PS2Mouse* mouse = _mice[i];
+    const uint8_t variant = (mouse->has_wheel() ? 1 : 0) | (mouse->has_4th_and_5th_buttons() ? 2 : 0) |
+                            ((mouse->get_scale() == PS2Mouse::Scale::TWO_ONE) ? 4 : 0);
+    if (!encoded[variant]) {
+      packets[variant] = mouse->make_packet(x, y, wheel, left, right, middle, button_4, button_5);
+      encoded[variant] = true;
+    }
+    port_packets[i] = mouse->data_reporting_enabled() ? &packets[variant] : nullptr;
+  }
+
+  // all packets are ready before the first one is queued, so that the hosts start as close together as possible
+  const uint8_t buttons = (left ? 0x01 : 0) | (right ? 0x02 : 0) | (middle ? 0x04 : 0) | (button_4 ? 0x08 : 0) | (button_5 ? 0x10 : 0);
+  const bool may_skip = (buttons == _last_buttons);
+  _last_buttons = buttons;
+  return _dispatch(port_packets, may_skip, ticks_to_wait);
+}
+
+size_t PS2MouseGroup::move(int16_t x, int16_t y, int8_t wheel, TickType_t ticks_to_wait) {
+  return send_report(x, y, wheel, _buttons[0], _buttons[1], _buttons[2], _buttons[3], _buttons[4], ticks_to_wait);
+}
+
+size_t PS2MouseGroup::press(PS2Mouse::Button button, TickType_t ticks_to_wait) {
+  _buttons[(size_t)button] = true;
+  return move(0, 0, 0, ticks_to_wait);
+}
+
+size_t PS2MouseGroup::release(PS2Mouse::Button button, TickType_t ticks_to_wait) {
+  _buttons[(size_t)button] = false;
+  return move(0, 0, 0, ticks_to_wait);
+}
+
+}  // namespace esp32_ps2dev
@@ -0,0 +1,39 @@
+#ifndef C9065C16_EF89_4283_996B_FA32071D6438
+#define C9065C16_EF89_4283_996B_FA32071D6438
+
+#include "PS2DevGroup.hpp"
+#include "PS2Mouse.hpp"
+
+namespace esp32_ps2dev {
+
+const size_t MOUSE_GROUP_MAX_PORTS = DEV_GROUP_MAX_PORTS;
+
+// Fans one stream of mouse reports out to several hosts, one PS2Mouse per host.
+// Each report is encoded once per protocol variant negotiated by the hosts (plain 3-byte, wheel, 5-button, 2:1 scaling),
+// then queued on every port back to back, see PS2DevGroup.
+// Unlike PS2Mouse::move(), reports are sent right away instead of at the sample rate of each host.
+// Late hosts are skipped for reports that only move, so they catch up instead of drifting further behind,
+// at the cost of that motion. Reports that change the buttons are never skipped.
+class PS2MouseGroup : public PS2DevGroup {
+ public:
+  PS2MouseGroup();
+  // Takes over the packet completion callback of `mouse`. Returns 0 on success, -1 if the group is full.
+  int add(PS2Mouse& mouse);
+  // Returns the number of hosts the report was queued for. Hosts with data reporting disabled are skipped.
+  // With ticks_to_wait, a full queue of one host delays the report to the following hosts.
+  size_t send_report(int16_t x, int16_t y, int8_t wheel, bool left, bool right, bool middle, bool button_4, bool button_5,
+                     TickType_t ticks_to_wait = 0);
+  size_t move(int16_t x, int16_t y, int8_t wheel, TickType_t ticks_to_wait = 0);
+  size_t press(PS2Mouse::Button button, TickType_t ticks_to_wait = 0);
+  size_t release(PS2Mouse::Button button, TickType_t ticks_to_wait = 0);
+
+ protected:
+  PS2Mouse* _mice[MOUSE_GROUP_MAX_PORTS] = {};
+  bool _buttons[5] = {};
+  // buttons of the last report, bit 0 left to bit 4 button 5
+  uint8_t _last_buttons = 0;
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* C9065C16_EF89_4283_996B_FA32071D6438 */
@@ -0,0 +1,198 @@
+#include "PS2PacketQueue.hpp"
+
+namespace esp32_ps2dev {
+
+int PS2PacketQueue::begin(size_t capacity) { return begin(new PS2Packet[capacity], capacity); }
+
+int PS2PacketQueue::begin(PS2Packet* storage, size_t capacity) {
+  if (storage == nullptr || capacity == 0) return -1;
+  _storage = storage;
+  _capacity = capacity;
+  _head = 0;
+  _count = 0;
+  _sem_packets = xSemaphoreCreateBinaryStatic(&_sem_packets_buffer);
+  _sem_space = xSemaphoreCreateBinaryStatic(&_sem_space_buffer);
+  return 0;
+}
+
+// Waits up to `ticks_to_wait` for a free slot. The overflow policy applies when the queue is still full after that,
+// so with 0 ticks the policy applies right away.
+int PS2PacketQueue::push(const PS2Packet& packet, TickType_t ticks_to_wait) {
+  if (_storage == nullptr) return -1;
+  const TickType_t started = xTaskGetTickCount();
+  while (true) {
+    TickType_t remaining = portMAX_DELAY;
+    if (ticks_to_wait != portMAX_DELAY) {
+      const TickType_t elapsed = xTaskGetTickCount() - started;
+      remaining = (elapsed >= ticks_to_wait) ? 0 : ticks_to_wait - elapsed;
+    }
+    const int ret = _push(packet, remaining == 0);
+    if (ret == 0 || remaining == 0) return ret;
+    // the semaphore is only a wake-up hint, the count is always checked under the lock
+    xSemaphoreTake(_sem_space, remaining);
+  }
+}
+
+// Returns 0 if the packet was queued or merged, -1 if the queue is full.
+int PS2PacketQueue::_push(const PS2Packet& packet, bool overflow) {
+  PS2Packet dropped;
+  bool has_dropped = false;
+  taskENTER_CRITICAL(&_mux);
+  if (_count >= _capacity) {
+    if (!overflow) {
+      taskEXIT_CRITICAL(&_mux);
+      return -1;
+    }
+    if (_overflow_policy == PS2OverflowPolicy::MERGE_MOTION && packet.kind == PS2PacketKind::MOTION && _merger) {
+      // merge into the newest motion packet, so that no displacement is lost
+      for (size_t i = _count; i > 0; i--) {
+        PS2Packet& queued = _storage[(_head + i - 1) % _capacity];
+        if (queued.kind != PS2PacketKind::MOTION) continue;
+        if (_merger(queued, packet)) {
+          _merged_count++;
+          taskEXIT_CRITICAL(&_mux);
+          if (_on_drop) _on_drop(packet);
+          return 0;
+        }
+        break;
+      }
+    }
+    if (!_make_room(&dropped)) {
+      _rejected_count++;
+      taskEXIT_CRITICAL(&_mux);
+      return -1;
+    }
+    has_dropped = true;
+  }
+  _storage[(_head + _count) % _capacity] = packet;
+  _count++;
+  const size_t depth = _count;
+  const bool high = (!_above_high_watermark && _high_watermark > 0 && depth >= _high_watermark);
+  if (high) _above_high_watermark = true;
+  taskEXIT_CRITICAL(&_mux);
+
+  xSemaphoreGive(_sem_packets);
+  if (_notify_task != nullptr) xTaskNotifyGive(_notify_task);
+  if (has_dropped && _on_drop) _on_drop(dropped);
+  if (high && _on_high_watermark) _on_high_watermark(depth);
+  return 0;
+}
+
+bool PS2PacketQueue::pop(PS2Packet* packet, TickType_t ticks_to_wait) {
+  if (_storage == nullptr) return false;
+  const TickType_t started = xTaskGetTickCount();
+  while (true) {
+    taskENTER_CRITICAL(&_mux);
+    if (_count > 0) {
+      *packet = _storage[_head];
+      _head = (_head + 1) % _capacity;
+      _count--;
+      const size_t depth = _count;
+      const bool low = (_above_high_watermark && depth <= _low_watermark);
+      if (low) _above_high_watermark = false;
+      taskEXIT_CRITICAL(&_mux);
+      xSemaphoreGive(_sem_space);
+      if (low && _on_low_watermark) _on_low_watermark(depth);
+      return true;
+    }
+    taskEXIT_CRITICAL(&_mux);
+    TickType_t remaining = portMAX_DELAY;
+    if (ticks_to_wait != portMAX_DELAY) {
+      const TickType_t elapsed = xTaskGetTickCount() - started;
+      if (elapsed >= ticks_to_wait) return false;
+      remaining = ticks_to_wait - elapsed;
+    }
+    // the semaphore is only a wake-up hint, the count is always checked under the lock
+    xSemaphoreTake(_sem_packets, remaining);
+  }
+}
+
+size_t PS2PacketQueue::size() { return _count; }
+size_t PS2PacketQueue::capacity() { return _capacity; }
+size_t PS2PacketQueue::free_slots() { return _capacity - _count; }
+
+// `on_high` is called when the depth reaches `high`, then `on_low` when it falls back to `low`.
+// They are called from the pushing and the popping task, outside of the queue lock. A `high` of 0 disables them.
+void PS2PacketQueue::set_watermarks(size_t high, size_t low, PS2WatermarkCallback on_high, PS2WatermarkCallback on_low) {
+  taskENTER_CRITICAL(&_mux);
+  _high_watermark = high;
+  _low_watermark = low;
+  _above_high_watermark = false;
+  taskEXIT_CRITICAL(&_mux);
+  _on_high_watermark = on_high;
+  _on_low_watermark = on_low;
+}
+void PS2PacketQueue::set_notify_task(TaskHandle_t task) { _notify_task = task; }
+
+void PS2PacketQueue::set_overflow_policy(PS2OverflowPolicy policy) { _overflow_policy = policy; }
+void PS2PacketQueue::set_merger(PS2PacketMerger merger) { _merger = merger; }
+// Called from the pushing task, outside of the queue lock.
+void PS2PacketQueue::set_drop_callback(PS2PacketDropCallback callback) { _on_drop = callback; }
+uint32_t PS2PacketQueue::get_merged_count() { return _merged_count; }
+uint32_t PS2PacketQueue::get_dropped_count() { return _dropped_count; }
+uint32_t PS2PacketQueue::get_rejected_count() { return _rejected_count; }
+
+// Drops the oldest motion packet if the policy allows it. Called in the critical section with the queue full.
+bool PS2PacketQueue::_make_room(PS2Packet* dropped) {
+  if (_overflow_policy == PS2OverflowPolicy::REJECT) return false;
+  for (size_t i = 0; i < _count; i++) {
+    if (_storage[(_head + i) % _capacity].kind == PS2PacketKind::MOTION) {
+      *dropped = _storage[(_head + i) % _capacity];
+      _remove(i);
+      _dropped_count++;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Removes the packet at `index` from the head, keeping the order of the others.
+void PS2PacketQueue::_remove(size_t index) {
+  for (size_t i = index; i + 1 < _count; i++) {
+    _storage[(_head + i) % _capacity] = _storage[(_head + i + 1) % _capacity];
+  }
+  _count--;
+}
+
+size_t PS2PacketQueue::drop_all() { return _drop(true, PS2PacketKind::OTHER); }
+size_t PS2PacketQueue::drop_kind(PS2PacketKind kind) { return _drop(false, kind); }
+
+// Drops one packet at a time, so that the drop callback runs outside of the lock.
+size_t PS2PacketQueue::_drop(bool any_kind, PS2PacketKind kind) {
+  size_t dropped_count = 0;
+  while (true) {
+    PS2Packet dropped;
+    bool found = false;
+    taskENTER_CRITICAL(&_mux);
+    for (size_t i = 0; i < _count && !found; i++) {
+      if (any_kind || _storage[(_head + i) % _capacity].kind == kind) {
+        dropped = _storage[(_head + i) % _capacity];
+        _remove(i);
+        _dropped_count++;
+        found = true;
+      }
+    }
+    const bool low = found && _above_high_watermark && _count <= _low_watermark;
+    if (low) _above_high_watermark = false;
+    const size_t depth = _count;
+    taskEXIT_CRITICAL(&_mux);
+    if (!found) return dropped_count;
+    dropped_count++;
+    xSemaphoreGive(_sem_space);
+    if (_on_drop) _on_drop(dropped);
+    if (low && _on_low_watermark) _on_low_watermark(depth);
+  }
+}
+
+void PS2PacketQueue::clear() {
+  taskENTER_CRITICAL(&_mux);
+  _head = 0;
+  _count = 0;
+  const bool low = _above_high_watermark;
+  _above_high_watermark = false;
+  taskEXIT_CRITICAL(&_mux);
+  if (_sem_space != nullptr) xSemaphoreGive(_sem_space);
+  if (low && _on_low_watermark) _on_low_watermark(0);
+}
+
+}  // namespace esp32_ps2dev
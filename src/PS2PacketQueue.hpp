@@ -0,0 +1,121 @@
+#ifndef C649C76F_619D_4EA8_BBE9_9C602EB131C8
+#define C649C76F_619D_4EA8_BBE9_9C602EB131C8
+
+#include <functional>
+
+#include "Arduino.h"
+
+namespace esp32_ps2dev {
+
+const size_t DEFAULT_PACKET_QUEUE_LENGTH = 20;
+
+// What a packet carries, so that the overflow policy knows which packets may be merged or dropped.
+enum class PS2PacketKind : uint8_t {
+  OTHER,
+  MOTION,  // mouse movement and buttons, a later report supersedes it
+  KEY,     // key make or break codes, never dropped
+};
+
+class PS2Packet {
+ public:
+  uint8_t len;
+  uint8_t data[16];
+  PS2PacketKind kind = PS2PacketKind::OTHER;
+  // set by PS2dev when the packet is queued
+  uint32_t ticket = 0;
+  int64_t enqueued_micros = 0;
+};
+
+enum class PS2PacketStatus : uint8_t {
+  SENT,
+  ABORTED,  // the host interrupted every attempt to send it
+  DROPPED,  // rejected or dropped by the overflow policy, or merged into another packet
+};
+
+// Outcome of a queued packet. Times are from esp_timer_get_time(), started_micros is 0 if it never went on the wire.
+struct PS2PacketCompletion {
+  uint32_t ticket;
+  PS2PacketStatus status;
+  int64_t enqueued_micros;
+  int64_t started_micros;
+  int64_t finished_micros;
+};
+
+// What push() does when the queue is full.
+enum class PS2OverflowPolicy : uint8_t {
+  REJECT,              // the new packet is rejected
+  DROP_OLDEST_MOTION,  // the oldest motion packet is dropped to make room, other packets are never dropped
+  MERGE_MOTION,        // a motion packet is merged into the newest queued one, or else as DROP_OLDEST_MOTION
+};
+
+// Merges `packet` into `newest`, a queued packet. Returns false if they cannot be merged.
+// Called in a critical section, so it must be short and must not block.
+typedef std::function<bool(PS2Packet& newest, const PS2Packet& packet)> PS2PacketMerger;
+// Called with the number of queued packets when a watermark is crossed.
+typedef std::function<void(size_t depth)> PS2WatermarkCallback;
+// Called with a packet that the overflow policy dropped or merged into another one.
+typedef std::function<void(const PS2Packet& packet)> PS2PacketDropCallback;
+
+// Fixed-capacity FIFO of packets stored by value.
+// The storage is allocated once in begin() (or provided by the caller), push() and pop() never touch the heap.
+class PS2PacketQueue {
+ public:
+  int begin(size_t capacity);
+  int begin(PS2Packet* storage, size_t capacity);
+  // Waits up to `ticks_to_wait` for a free slot, then applies the overflow policy.
+  // Returns 0 if the packet was queued or merged, -1 if it was rejected.
+  int push(const PS2Packet& packet, TickType_t ticks_to_wait = 0);
+  // Waits up to `ticks_to_wait` for a packet. Returns true if a packet was copied to `packet`.
+  bool pop(PS2Packet* packet, TickType_t ticks_to_wait);
+  size_t size();
+  size_t capacity();
+  size_t free_slots();
+  void clear();
+  // Remove queued packets, all of them or those of one kind, calling the drop callback for each.
+  // Return the number of packets dropped.
+  size_t drop_all();
+  size_t drop_kind(PS2PacketKind kind);
+  // Task notified on every push, for a consumer that waits on other events as well and polls with pop(packet, 0).
+  void set_notify_task(TaskHandle_t task);
+  void set_overflow_policy(PS2OverflowPolicy policy);
+  void set_merger(PS2PacketMerger merger);
+  void set_drop_callback(PS2PacketDropCallback callback);
+  void set_watermarks(size_t high, size_t low, PS2WatermarkCallback on_high, PS2WatermarkCallback on_low);
+  // Number of packets merged, dropped and rejected on overflow since begin().
+  uint32_t get_merged_count();
+  uint32_t get_dropped_count();
+  uint32_t get_rejected_count();
+
+ protected:
+  PS2Packet* _storage = nullptr;
+  size_t _capacity = 0;
+  size_t _head = 0;
+  size_t _count = 0;
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  // given on every push so that pop() can block without polling
+  SemaphoreHandle_t _sem_packets = nullptr;
+  StaticSemaphore_t _sem_packets_buffer;
+  // given on every pop so that push() can block without polling
+  SemaphoreHandle_t _sem_space = nullptr;
+  StaticSemaphore_t _sem_space_buffer;
+  TaskHandle_t _notify_task = nullptr;
+  PS2OverflowPolicy _overflow_policy = PS2OverflowPolicy::REJECT;
+  PS2PacketMerger _merger;
+  uint32_t _merged_count = 0;
+  uint32_t _dropped_count = 0;
+  uint32_t _rejected_count = 0;
+  size_t _high_watermark = 0;
+  size_t _low_watermark = 0;
+  bool _above_high_watermark = false;
+  PS2WatermarkCallback _on_high_watermark;
+  PS2WatermarkCallback _on_low_watermark;
+  PS2PacketDropCallback _on_drop;
+  int _push(const PS2Packet& packet, bool overflow);
+  bool _make_room(PS2Packet* dropped);
+  size_t _drop(bool any_kind, PS2PacketKind kind);
+  void _remove(size_t index);
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* C649C76F_619D_4EA8_BBE9_9C602EB131C8 */
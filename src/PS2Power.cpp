@@ -0,0 +1,32 @@
+#include "PS2Power.hpp"
+
+#include <driver/rtc_io.h>
+#include <esp_sleep.h>
+
+namespace esp32_ps2dev {
+
+int PS2PmLock::begin(const char* name) {
+  if (_handle != nullptr) return 0;
+  if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, name, &_handle) != ESP_OK) {
+    _handle = nullptr;
+    return -1;
+  }
+  return 0;
+}
+
+// Wake-up pins of all ports, the RTC controller takes them as one mask.
+static uint64_t wakeup_pin_mask = 0;
+
+// The RTC controller is used rather than GPIO wake-up, which would turn the edge interrupts on the pin into level interrupts.
+int ps2_enable_light_sleep_wakeup(int pin) {
+  if (!rtc_gpio_is_valid_gpio((gpio_num_t)pin)) return -1;
+  wakeup_pin_mask |= 1ULL << pin;
+#ifdef CONFIG_IDF_TARGET_ESP32
+  const esp_sleep_ext1_wakeup_mode_t mode = ESP_EXT1_WAKEUP_ALL_LOW;
+#else
+  const esp_sleep_ext1_wakeup_mode_t mode = ESP_EXT1_WAKEUP_ANY_LOW;
+#endif
+  return (esp_sleep_enable_ext1_wakeup(wakeup_pin_mask, mode) == ESP_OK) ? 0 : -1;
+}
+
+}  // namespace esp32_ps2dev
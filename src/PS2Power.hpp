@@ -0,0 +1,33 @@
+#ifndef D35CA805_0F6A_46BF_BFA1_A22531D3AE8C
+#define D35CA805_0F6A_46BF_BFA1_A22531D3AE8C
+
+#include <esp_pm.h>
+
+#include "Arduino.h"
+
+namespace esp32_ps2dev {
+
+// Keeps the CPU at its maximum frequency while held, so that frames keep their timing under dynamic frequency scaling.
+// Light sleep is also held off while the lock is held. Does nothing when power management is not enabled.
+class PS2PmLock {
+ public:
+  // Returns 0 on success, -1 if power management is not enabled.
+  int begin(const char* name);
+  inline void acquire() {
+    if (_handle != nullptr) esp_pm_lock_acquire(_handle);
+  }
+  inline void release() {
+    if (_handle != nullptr) esp_pm_lock_release(_handle);
+  }
+
+ protected:
+  esp_pm_lock_handle_t _handle = nullptr;
+};
+
+// Lets `pin` going low wake the chip from light sleep. Returns 0 on success, -1 if the pin cannot wake the chip.
+// The RTC controller of the ESP32 wakes only when all the pins are low, so only one port can wake it there.
+int ps2_enable_light_sleep_wakeup(int pin);
+
+}  // namespace esp32_ps2dev
+
+#endif /* D35CA805_0F6A_46BF_BFA1_A22531D3AE8C */
@@ -0,0 +1,225 @@
+#include "PS2Proxy.hpp"
+
+namespace esp32_ps2dev {
+
+const uint8_t PROXY_CMD_RESET = 0xFF;
+const uint8_t PROXY_CMD_ENABLE_DATA_REPORTING = 0xF4;
+const uint8_t PROXY_CMD_SET_SAMPLE_RATE = 0xF3;
+const uint8_t PROXY_CMD_GET_DEVICE_ID = 0xF2;
+const uint8_t PROXY_CMD_SET_LEDS = 0xED;
+const uint8_t PROXY_SELF_TEST_PASSED = 0xAA;
+const uint8_t PROXY_ACK = 0xFA;
+const uint8_t PROXY_RESEND = 0xFE;
+
+void PS2ForwardLatency::on_forwarded(uint32_t ticket, int64_t received_micros) {
+  const size_t slot = ticket % PROXY_LATENCY_SLOTS;
+  _tickets[slot] = ticket;
+  _received_micros[slot] = received_micros;
+}
+
+// Called from the send task of the emulated device. Packets that were not forwarded have no slot.
+void PS2ForwardLatency::on_completion(const PS2PacketCompletion& completion) {
+  const size_t slot = completion.ticket % PROXY_LATENCY_SLOTS;
+  if (completion.status != PS2PacketStatus::SENT || completion.ticket == 0 || _tickets[slot] != completion.ticket) return;
+  _tickets[slot] = 0;
+  _last_micros = completion.finished_micros - _received_micros[slot];
+  if (_last_micros > _max_micros) _max_micros = _last_micros;
+}
+
+int64_t PS2ForwardLatency::last() { return _last_micros; }
+int64_t PS2ForwardLatency::max() { return _max_micros; }
+
+PS2MouseProxy::PS2MouseProxy(PS2Host& host, PS2Mouse& mouse) : _host(&host), _mouse(&mouse) {}
+
+int PS2MouseProxy::begin() {
+  _host->begin();
+  uint8_t response[2];
+  if (_host->command(PROXY_CMD_RESET, response, 2, PROXY_RESET_TIMEOUT_MILLIS) != 0 || response[0] != PROXY_SELF_TEST_PASSED) {
+    PS2DEV_LOGE("PS2MouseProxy::begin: mouse did not answer reset");
+    return -1;
+  }
+  // the same sample rate sequences PS2Mouse recognizes, see PS2Mouse::reply_to_host()
+  uint8_t id = 0;
+  if (_set_sample_rate(200) == 0 && _set_sample_rate(100) == 0 && _set_sample_rate(80) == 0) {
+    _host->command(PROXY_CMD_GET_DEVICE_ID, &id, 1);
+  }
+  if (id == 3 && _set_sample_rate(200) == 0 && _set_sample_rate(200) == 0 && _set_sample_rate(80) == 0) {
+    _host->command(PROXY_CMD_GET_DEVICE_ID, &id, 1);
+  }
+  _device_id = id;
+  _packet_len = (id == 3 || id == 4) ? 4 : 3;
+  _set_sample_rate(100);
+  if (_host->command(PROXY_CMD_ENABLE_DATA_REPORTING) != 0) {
+    PS2DEV_LOGE("PS2MouseProxy::begin: mouse did not enable data reporting");
+    return -1;
+  }
+  _mouse->set_packet_completion_callback(
+      [this](const PS2Packet& packet, const PS2PacketCompletion& completion) { _latency.on_completion(completion); });
+  xTaskCreateUniversal(_taskfn_mouse_proxy, "PS2MouseProxy", DEFAULT_TASK_STACK_SIZE, this, DEFAULT_TASK_PRIORITY, &_task, DEFAULT_TASK_CORE);
+  return 0;
+}
+
+void PS2MouseProxy::set_hook(PS2MouseProxyHook hook) { _hook = hook; }
+uint8_t PS2MouseProxy::get_device_id() { return _device_id; }
+int64_t PS2MouseProxy::get_forward_latency_micros() { return _latency.last(); }
+int64_t PS2MouseProxy::get_max_forward_latency_micros() { return _latency.max(); }
+
+int PS2MouseProxy::_set_sample_rate(uint8_t rate) {
+  const int ret = _host->command(PROXY_CMD_SET_SAMPLE_RATE);
+  return (ret == 0) ? _host->command(rate) : ret;
+}
+
+void PS2MouseProxy::_forward(const uint8_t* data, int64_t received_micros) {
+  PS2MouseReport report;
+  report.left = data[0] & 0x01;
+  report.right = data[0] & 0x02;
+  report.middle = data[0] & 0x04;
+  // movements are 9-bit two's complement, the sign bits are in the first byte
+  report.x = (int16_t)(data[1] | ((data[0] & 0x10) ? 0xFF00 : 0));
+  report.y = (int16_t)(data[2] | ((data[0] & 0x20) ? 0xFF00 : 0));
+  report.wheel = 0;
+  report.button_4 = false;
+  report.button_5 = false;
+  if (_device_id == 3) {
+    report.wheel = (int8_t)data[3];
+  } else if (_device_id == 4) {
+    report.wheel = (int8_t)(data[3] << 4) / 16;
+    report.button_4 = data[3] & 0x10;
+    report.button_5 = data[3] & 0x20;
+  }
+  if (_hook && !_hook(report)) return;
+  if (!_mouse->data_reporting_enabled()) return;
+  const PS2Packet packet =
+      _mouse->make_packet(report.x, report.y, report.wheel, report.left, report.right, report.middle, report.button_4, report.button_5);
+  uint32_t ticket;
+  if (_mouse->send_packet_to_queue(packet, 0, &ticket) == 0) _latency.on_forwarded(ticket, received_micros);
+}
+
+void _taskfn_mouse_proxy(void* arg) {
+  PS2MouseProxy* proxy = (PS2MouseProxy*)arg;
+  uint8_t data[4];
+  size_t len = 0;
+  while (true) {
+    uint8_t value;
+    int64_t received_micros;
+    if (proxy->_host->read(&value, PROXY_PACKET_GAP_MILLIS, &received_micros) != 0) {
+      len = 0;
+      continue;
+    }
+    // bit 3 of the first byte is always set, anything else means we lost sync
+    if (len == 0 && !(value & 0x08)) continue;
+    data[len++] = value;
+    if (len == proxy->_packet_len) {
+      proxy->_forward(data, received_micros);
+      len = 0;
+    }
+  }
+  vTaskDelete(NULL);
+}
+
+PS2KeyboardProxy::PS2KeyboardProxy(PS2Host& host, PS2Keyboard& keyboard) : _host(&host), _keyboard(&keyboard) {}
+
+int PS2KeyboardProxy::begin() {
+  _host->begin();
+  uint8_t response;
+  if (_host->command(PROXY_CMD_RESET, &response, 1, PROXY_RESET_TIMEOUT_MILLIS) != 0 || response != PROXY_SELF_TEST_PASSED) {
+    PS2DEV_LOGE("PS2KeyboardProxy::begin: keyboard did not answer reset");
+    return -1;
+  }
+  _leds = 0;
+  _led_sync = LedSync::IDLE;
+  _keyboard->set_packet_completion_callback(
+      [this](const PS2Packet& packet, const PS2PacketCompletion& completion) { _latency.on_completion(completion); });
+  xTaskCreateUniversal(_taskfn_keyboard_proxy, "PS2KeyboardProxy", DEFAULT_TASK_STACK_SIZE, this, DEFAULT_TASK_PRIORITY, &_task,
+                       DEFAULT_TASK_CORE);
+  return 0;
+}
+
+void PS2KeyboardProxy::set_hook(PS2KeyboardProxyHook hook) { _hook = hook; }
+int64_t PS2KeyboardProxy::get_forward_latency_micros() { return _latency.last(); }
+int64_t PS2KeyboardProxy::get_max_forward_latency_micros() { return _latency.max(); }
+
+void PS2KeyboardProxy::_forward(PS2Packet& scancode, int64_t received_micros) {
+  if (_hook && !_hook(scancode)) return;
+  if (!_keyboard->data_reporting_enabled()) return;
+  scancode.kind = PS2PacketKind::KEY;
+  uint32_t ticket;
+  if (_keyboard->send_packet_to_queue(scancode, 0, &ticket) == 0) _latency.on_forwarded(ticket, received_micros);
+}
+
+// Starts copying the LEDs set by the computer on the PS2Keyboard to the physical keyboard, between scancodes.
+// Each byte is sent without waiting for its ACK, which _on_led_response() picks out of the bytes the keyboard sends.
+void PS2KeyboardProxy::_sync_leds() {
+  if (_led_sync != LedSync::IDLE) {
+    // no ACK, the update is tried again
+    if (millis() - _led_sync_since_millis > DEFAULT_HOST_RESPONSE_TIMEOUT_MILLIS) _led_sync = LedSync::IDLE;
+    return;
+  }
+  const uint8_t leds = (_keyboard->is_scroll_lock_led_on() ? 0x01 : 0) | (_keyboard->is_num_lock_led_on() ? 0x02 : 0) |
+                       (_keyboard->is_caps_lock_led_on() ? 0x04 : 0);
+  if (leds == _leds || _host->write(PROXY_CMD_SET_LEDS) != 0) return;
+  _leds_sending = leds;
+  _led_sync = LedSync::COMMAND_SENT;
+  _led_sync_since_millis = millis();
+}
+
+// Returns true if `value` answers the LED update in progress.
+bool PS2KeyboardProxy::_on_led_response(uint8_t value) {
+  if (_led_sync == LedSync::IDLE || (value != PROXY_ACK && value != PROXY_RESEND)) return false;
+  if (value == PROXY_RESEND) {
+    _led_sync = LedSync::IDLE;
+  } else if (_led_sync == LedSync::COMMAND_SENT) {
+    _led_sync = (_host->write(_leds_sending) == 0) ? LedSync::LEDS_SENT : LedSync::IDLE;
+    _led_sync_since_millis = millis();
+  } else {
+    _leds = _leds_sending;
+    _led_sync = LedSync::IDLE;
+  }
+  return true;
+}
+
+// Bytes the keyboard sends in reply to commands or on errors, never the first byte of a scancode.
+static bool is_keyboard_response(uint8_t value) {
+  switch (value) {
+    case 0x00:  // key detection error
+    case 0xAA:  // self-test passed
+    case 0xEE:  // echo
+    case 0xFA:  // acknowledge
+    case 0xFC:  // self-test failed
+    case 0xFD:  // self-test failed
+    case 0xFE:  // resend
+    case 0xFF:  // key detection error
+      return true;
+    default:
+      return false;
+  }
+}
+
+void _taskfn_keyboard_proxy(void* arg) {
+  PS2KeyboardProxy* proxy = (PS2KeyboardProxy*)arg;
+  PS2Packet scancode;
+  scancode.len = 0;
+  while (true) {
+    if (scancode.len == 0) proxy->_sync_leds();
+    uint8_t value;
+    int64_t received_micros;
+    if (proxy->_host->read(&value, PROXY_PACKET_GAP_MILLIS, &received_micros) != 0) {
+      scancode.len = 0;
+      continue;
+    }
+    if (scancode.len == 0 && (proxy->_on_led_response(value) || is_keyboard_response(value))) continue;
+    scancode.data[scancode.len++] = value;
+    if (scancode.data[0] == 0xE1) {
+      // Pause is the only key with an 8-byte make code and no break code: E1 14 77 E1 F0 14 F0 77
+      if (scancode.len < 8) continue;
+    } else if (value == 0xE0 || value == 0xF0) {
+      // prefix of an extended key or a break code
+      continue;
+    }
+    proxy->_forward(scancode, received_micros);
+    scancode.len = 0;
+  }
+  vTaskDelete(NULL);
+}
+
+}  // namespace esp32_ps2dev
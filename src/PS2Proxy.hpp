@@ -0,0 +1,122 @@
+#ifndef C91C93A7_0ECC_4AAA_B463_AF8D774CCC36
+#define C91C93A7_0ECC_4AAA_B463_AF8D774CCC36
+
+#include "PS2Host.hpp"
+#include "PS2Keyboard.hpp"
+#include "PS2Mouse.hpp"
+
+namespace esp32_ps2dev {
+
+// The device answers a reset after its self-test, which takes up to about a second.
+const uint32_t PROXY_RESET_TIMEOUT_MILLIS = 1000;
+// Bytes of one packet arrive within this time of each other, a longer gap starts a new packet.
+const uint32_t PROXY_PACKET_GAP_MILLIS = 20;
+
+// Forwarded packets whose reception time is kept until they are complete on the wire to the computer.
+const size_t PROXY_LATENCY_SLOTS = 16;
+
+// Forwarding latency: time from the last byte of a report or scancode received from the physical device
+// to the last byte of the forwarded packet sent to the computer, from the completion of the packet.
+// A report is forwarded once complete, so this is at least the time to send it again, about 1 ms per byte,
+// plus the time it waited for the bus to the computer.
+class PS2ForwardLatency {
+ public:
+  void on_forwarded(uint32_t ticket, int64_t received_micros);
+  void on_completion(const PS2PacketCompletion& completion);
+  int64_t last();
+  int64_t max();
+
+ protected:
+  uint32_t _tickets[PROXY_LATENCY_SLOTS] = {};
+  int64_t _received_micros[PROXY_LATENCY_SLOTS] = {};
+  int64_t _last_micros = 0;
+  int64_t _max_micros = 0;
+};
+
+struct PS2MouseReport {
+  int16_t x;
+  int16_t y;
+  int8_t wheel;
+  bool left;
+  bool right;
+  bool middle;
+  bool button_4;
+  bool button_5;
+};
+
+// Called with each report or scancode before it is forwarded. It may change it, or return false to drop it.
+typedef std::function<bool(PS2MouseReport& report)> PS2MouseProxyHook;
+typedef std::function<bool(PS2Packet& scancode)> PS2KeyboardProxyHook;
+
+void _taskfn_mouse_proxy(void* arg);
+void _taskfn_keyboard_proxy(void* arg);
+
+// Forwards a physical mouse on a PS2Host to the computer through a PS2Mouse.
+// The PS2Mouse keeps answering the commands of the computer, and each report of the physical mouse is queued on it
+// as soon as its last byte is received, encoded for the protocol the computer negotiated.
+// Own events are injected through the PS2Mouse as usual. begin() takes over its packet completion callback.
+class PS2MouseProxy {
+ public:
+  PS2MouseProxy(PS2Host& host, PS2Mouse& mouse);
+  // Resets the physical mouse, enables its wheel and 4th and 5th buttons when it has them, and starts forwarding.
+  // Call it after mouse.begin(). Returns 0 on success, -1 if the physical mouse did not answer.
+  int begin();
+  void set_hook(PS2MouseProxyHook hook);
+  // Device ID of the physical mouse: 0 standard, 3 with wheel, 4 with wheel and 4th and 5th buttons.
+  uint8_t get_device_id();
+  // Forwarding latency of the last report sent and the largest so far, see PS2ForwardLatency.
+  int64_t get_forward_latency_micros();
+  int64_t get_max_forward_latency_micros();
+
+ protected:
+  int _set_sample_rate(uint8_t rate);
+  void _forward(const uint8_t* data, int64_t received_micros);
+  PS2ForwardLatency _latency;
+  PS2Host* _host;
+  PS2Mouse* _mouse;
+  PS2MouseProxyHook _hook;
+  uint8_t _device_id = 0;
+  uint8_t _packet_len = 3;
+  TaskHandle_t _task = nullptr;
+
+  friend void _taskfn_mouse_proxy(void* arg);
+};
+
+// Forwards a physical keyboard on a PS2Host to the computer through a PS2Keyboard.
+// Scancodes are queued on the PS2Keyboard as soon as they are complete, and the LEDs set by the computer
+// are copied to the physical keyboard between scancodes. Its ACKs are picked out of the bytes the keyboard sends,
+// so scancodes keep being forwarded while the LEDs are updated.
+// Own keystrokes are injected through the PS2Keyboard as usual. begin() takes over its packet completion callback.
+class PS2KeyboardProxy {
+ public:
+  PS2KeyboardProxy(PS2Host& host, PS2Keyboard& keyboard);
+  // Resets the physical keyboard and starts forwarding. Call it after keyboard.begin().
+  // Returns 0 on success, -1 if the physical keyboard did not answer.
+  int begin();
+  void set_hook(PS2KeyboardProxyHook hook);
+  // Forwarding latency of the last scancode sent and the largest so far, see PS2ForwardLatency.
+  int64_t get_forward_latency_micros();
+  int64_t get_max_forward_latency_micros();
+
+ protected:
+  enum class LedSync : uint8_t { IDLE, COMMAND_SENT, LEDS_SENT };
+
+  void _forward(PS2Packet& scancode, int64_t received_micros);
+  void _sync_leds();
+  bool _on_led_response(uint8_t value);
+  PS2ForwardLatency _latency;
+  PS2Host* _host;
+  PS2Keyboard* _keyboard;
+  PS2KeyboardProxyHook _hook;
+  uint8_t _leds = 0;
+  LedSync _led_sync = LedSync::IDLE;
+  uint8_t _leds_sending = 0;
+  uint32_t _led_sync_since_millis = 0;
+  TaskHandle_t _task = nullptr;
+
+  friend void _taskfn_keyboard_proxy(void* arg);
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* C91C93A7_0ECC_4AAA_B463_AF8D774CCC36 */
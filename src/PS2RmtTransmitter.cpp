@@ -0,0 +1,154 @@
+#include "PS2RmtTransmitter.hpp"
+
+#include <driver/gpio.h>
+#include <soc/rmt_periph.h>
+
+namespace esp32_ps2dev {
+
+// 80 MHz APB clock divided by 80 gives 1 microsecond per tick.
+const uint8_t RMT_CLK_DIV = 80;
+// Extra time allowed for a chunk on top of its length before giving up.
+const uint32_t RMT_TX_TIMEOUT_MARGIN_MILLIS = 10;
+
+// rmt_register_tx_end_callback() takes only one callback for all channels, so it is dispatched by channel here.
+static PS2RmtTransmitter* rmt_transmitters[RMT_CHANNEL_MAX] = {};
+
+PS2RmtTransmitter::PS2RmtTransmitter(rmt_channel_t clk_channel, rmt_channel_t data_channel, uint8_t mem_block_num)
+    : _clk_channel(clk_channel), _data_channel(data_channel), _mem_block_num(mem_block_num) {}
+
+int PS2RmtTransmitter::begin(int clk, int data) {
+  _ps2clk = clk;
+  _ps2data = data;
+
+  const rmt_channel_t channels[2] = {_clk_channel, _data_channel};
+  const int pins[2] = {clk, data};
+  for (int i = 0; i < 2; i++) {
+    rmt_config_t config = {};
+    config.rmt_mode = RMT_MODE_TX;
+    config.channel = channels[i];
+    config.gpio_num = pins[i];
+    config.clk_div = RMT_CLK_DIV;
+    config.mem_block_num = _mem_block_num;
+    config.tx_config.idle_level = RMT_IDLE_LEVEL_HIGH;
+    config.tx_config.idle_output_en = true;
+    config.tx_config.carrier_en = false;
+    config.tx_config.loop_en = false;
+    if (rmt_config(&config) != ESP_OK || rmt_driver_install(channels[i], 0, 0) != ESP_OK) {
+      PS2DEV_LOGE("PS2RmtTransmitter::begin: failed to configure RMT channel");
+      return -1;
+    }
+    rmt_transmitters[channels[i]] = this;
+  }
+  rmt_register_tx_end_callback(_on_tx_end, NULL);
+  // rmt_config() routes the pins to the RMT in push-pull mode, give them back to GPIO until the first transmission.
+  _detach();
+
+  // one item is reserved for the end marker
+  _max_items = _mem_block_num * RMT_MEM_ITEM_NUM - 1;
+  _max_bytes_per_chunk = (2 * _max_items - 2) / 24;
+  if (_max_bytes_per_chunk == 0) _max_bytes_per_chunk = 1;
+  _symbols = new PS2Symbol[2 * _max_items];
+  _clk_items = new rmt_item32_t[_max_items + 1];
+  _data_items = new rmt_item32_t[_max_items + 1];
+  return 0;
+}
+
+int PS2RmtTransmitter::transmit(const uint8_t* data, size_t len, uint32_t clk_half_period_micros, uint32_t byte_interval_micros) {
+  if (_symbols == nullptr) return -3;
+  const PS2FrameEncoder encoder(clk_half_period_micros, byte_interval_micros);
+  size_t sent = 0;
+  while (sent < len) {
+    size_t chunk = len - sent;
+    if (chunk > _max_bytes_per_chunk) chunk = _max_bytes_per_chunk;
+    if (sent > 0) delayMicroseconds(byte_interval_micros);
+    if (_transmit_chunk(data + sent, chunk, encoder) != 0) return -3;
+    sent += chunk;
+  }
+  return 0;
+}
+
+int PS2RmtTransmitter::_transmit_chunk(const uint8_t* data, size_t len, const PS2FrameEncoder& encoder) {
+  size_t n = encoder.encode_clk(len, _symbols, 2 * _max_items);
+  if (n == 0) return -1;
+  uint32_t duration_micros = 0;
+  for (size_t i = 0; i < n; i++) duration_micros += _symbols[i].duration_micros;
+  const size_t clk_items = _to_items(_symbols, n, _clk_items);
+
+  n = encoder.encode_data(data, len, _symbols, 2 * _max_items);
+  if (n == 0) return -1;
+  const size_t data_items = _to_items(_symbols, n, _data_items);
+
+  if (rmt_fill_tx_items(_clk_channel, _clk_items, clk_items, 0) != ESP_OK ||
+      rmt_fill_tx_items(_data_channel, _data_items, data_items, 0) != ESP_OK) {
+    return -1;
+  }
+
+  _waiting_task = xTaskGetCurrentTaskHandle();
+  _channels_running = 2;
+  ulTaskNotifyTake(pdTRUE, 0);
+  _attach();
+  // start both channels back to back, DATA first since it changes a quarter period before CLK falls
+  taskENTER_CRITICAL(&_mux);
+  rmt_tx_start(_data_channel, true);
+  rmt_tx_start(_clk_channel, true);
+  taskEXIT_CRITICAL(&_mux);
+
+  const auto timeout = pdMS_TO_TICKS(duration_micros / 1000 + RMT_TX_TIMEOUT_MARGIN_MILLIS);
+  const bool done = ulTaskNotifyTake(pdTRUE, timeout) > 0;
+  if (!done) {
+    rmt_tx_stop(_clk_channel);
+    rmt_tx_stop(_data_channel);
+  }
+  _detach();
+  _waiting_task = nullptr;
+  return done ? 0 : -1;
+}
+
+// Packs symbols into RMT items and appends a zero-length end marker.
+size_t PS2RmtTransmitter::_to_items(const PS2Symbol* symbols, size_t n, rmt_item32_t* items) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; i += 2) {
+    items[count].val = 0;
+    items[count].level0 = symbols[i].level;
+    items[count].duration0 = symbols[i].duration_micros;
+    if (i + 1 < n) {
+      items[count].level1 = symbols[i + 1].level;
+      items[count].duration1 = symbols[i + 1].duration_micros;
+    }
+    count++;
+  }
+  if (n % 2 == 0) {
+    items[count].val = 0;
+    count++;
+  }
+  return count;
+}
+
+// The lines are open-drain: the RMT output only sinks current, and the pins stay readable for get_bus_state().
+void PS2RmtTransmitter::_attach() {
+  gpio_set_direction((gpio_num_t)_ps2clk, GPIO_MODE_INPUT_OUTPUT_OD);
+  gpio_set_direction((gpio_num_t)_ps2data, GPIO_MODE_INPUT_OUTPUT_OD);
+  gpio_matrix_out(_ps2clk, rmt_periph_signals.groups[0].channels[_clk_channel].tx_sig, false, false);
+  gpio_matrix_out(_ps2data, rmt_periph_signals.groups[0].channels[_data_channel].tx_sig, false, false);
+}
+
+void PS2RmtTransmitter::_detach() {
+  gpio_set_level((gpio_num_t)_ps2clk, 1);
+  gpio_set_level((gpio_num_t)_ps2data, 1);
+  gpio_matrix_out(_ps2clk, SIG_GPIO_OUT_IDX, false, false);
+  gpio_matrix_out(_ps2data, SIG_GPIO_OUT_IDX, false, false);
+  gpio_set_direction((gpio_num_t)_ps2clk, GPIO_MODE_INPUT_OUTPUT_OD);
+  gpio_set_direction((gpio_num_t)_ps2data, GPIO_MODE_INPUT_OUTPUT_OD);
+}
+
+void IRAM_ATTR PS2RmtTransmitter::_on_tx_end(rmt_channel_t channel, void* arg) {
+  PS2RmtTransmitter* transmitter = rmt_transmitters[channel];
+  if (transmitter == nullptr || transmitter->_waiting_task == nullptr) return;
+  if (--transmitter->_channels_running == 0) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(transmitter->_waiting_task, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
+
+}  // namespace esp32_ps2dev
@@ -0,0 +1,52 @@
+#ifndef DA498F6E_28C7_4F8B_982B_A1ABE0E09929
+#define DA498F6E_28C7_4F8B_982B_A1ABE0E09929
+
+#include <driver/rmt.h>
+
+#include "Arduino.h"
+#include "Log.hpp"
+#include "PS2Frame.hpp"
+#include "PS2Transmitter.hpp"
+
+namespace esp32_ps2dev {
+
+// RMT channels are 64 items long. A channel using N memory blocks makes the following N-1 channels unusable,
+// so the default channels leave room for 3 blocks each on ESP32.
+const rmt_channel_t DEFAULT_RMT_CLK_CHANNEL = RMT_CHANNEL_0;
+const rmt_channel_t DEFAULT_RMT_DATA_CHANNEL = RMT_CHANNEL_4;
+const uint8_t DEFAULT_RMT_MEM_BLOCK_NUM = 3;
+
+// Sends packets by the RMT peripheral. CLK and DATA are driven by two channels which are started together,
+// and the calling task sleeps until both channels finish. Packets longer than the channel memory are split into chunks.
+// The host can not abort a frame in the middle, bus state is only checked before each packet.
+class PS2RmtTransmitter : public PS2Transmitter {
+ public:
+  PS2RmtTransmitter(rmt_channel_t clk_channel = DEFAULT_RMT_CLK_CHANNEL, rmt_channel_t data_channel = DEFAULT_RMT_DATA_CHANNEL,
+                    uint8_t mem_block_num = DEFAULT_RMT_MEM_BLOCK_NUM);
+  int begin(int clk, int data);
+  int transmit(const uint8_t* data, size_t len, uint32_t clk_half_period_micros, uint32_t byte_interval_micros);
+
+ protected:
+  int _transmit_chunk(const uint8_t* data, size_t len, const PS2FrameEncoder& encoder);
+  size_t _to_items(const PS2Symbol* symbols, size_t n, rmt_item32_t* items);
+  void _attach();
+  void _detach();
+  static void _on_tx_end(rmt_channel_t channel, void* arg);
+  rmt_channel_t _clk_channel;
+  rmt_channel_t _data_channel;
+  uint8_t _mem_block_num;
+  int _ps2clk = -1;
+  int _ps2data = -1;
+  size_t _max_items = 0;
+  size_t _max_bytes_per_chunk = 0;
+  PS2Symbol* _symbols = nullptr;
+  rmt_item32_t* _clk_items = nullptr;
+  rmt_item32_t* _data_items = nullptr;
+  TaskHandle_t _waiting_task = nullptr;
+  volatile uint8_t _channels_running = 0;
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* DA498F6E_28C7_4F8B_982B_A1ABE0E09929 */
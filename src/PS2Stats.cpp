@@ -0,0 +1,29 @@
+#include "PS2Stats.hpp"
+
+namespace esp32_ps2dev {
+
+size_t PS2StatsBlock::histogram_bucket(int64_t micros) {
+  if (micros <= 1) return 0;
+  if (micros >= (1LL << (STATS_HISTOGRAM_BUCKETS - 1))) return STATS_HISTOGRAM_BUCKETS - 1;
+  return 31 - __builtin_clz((uint32_t)micros);
+}
+
+// PS2Stats holds only uint32_t counters, so it is copied counter by counter.
+static_assert(sizeof(PS2Stats) % sizeof(uint32_t) == 0, "PS2Stats must hold only uint32_t counters");
+
+void PS2StatsBlock::snapshot(PS2Stats* out, bool reset) {
+  uint32_t* counters = (uint32_t*)&_stats;
+  uint32_t* copy = (uint32_t*)out;
+  for (size_t i = 0; i < sizeof(PS2Stats) / sizeof(uint32_t); i++) {
+    copy[i] = reset ? __atomic_exchange_n(&counters[i], 0, __ATOMIC_RELAXED) : __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+  }
+}
+
+void PS2StatsBlock::reset() {
+  uint32_t* counters = (uint32_t*)&_stats;
+  for (size_t i = 0; i < sizeof(PS2Stats) / sizeof(uint32_t); i++) {
+    __atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+  }
+}
+
+}  // namespace esp32_ps2dev
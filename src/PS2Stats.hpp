@@ -0,0 +1,58 @@
+#ifndef FD1AA1AC_67BF_45B3_B641_FFE0CC5AF1BB
+#define FD1AA1AC_67BF_45B3_B641_FFE0CC5AF1BB
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace esp32_ps2dev {
+
+// Bucket i of a histogram counts values from 2^i to 2^(i+1)-1 microseconds, bucket 0 also counts 0.
+// The last bucket counts everything above.
+const size_t STATS_HISTOGRAM_BUCKETS = 16;
+// Host commands are counted per opcode from 0xE0 to 0xFF, other bytes in host_commands_other.
+const uint8_t STATS_FIRST_HOST_COMMAND = 0xE0;
+const size_t STATS_HOST_COMMANDS = 0x100 - STATS_FIRST_HOST_COMMAND;
+
+struct PS2Stats {
+  uint32_t bytes_sent;
+  uint32_t packets_sent;
+  uint32_t host_commands[STATS_HOST_COMMANDS];
+  uint32_t host_commands_other;
+  uint32_t parity_errors;
+  uint32_t write_failures;    // nothing sent as the bus was not idle
+  uint32_t inhibits;          // the host took the bus in the middle of a frame or a packet
+  uint32_t queue_full_drops;  // packets rejected by the packet queue
+  uint32_t wakeups;           // times a task of the port woke up
+  uint32_t awake_micros;      // time the tasks of the port spent from waking up to waiting again
+  uint32_t queue_wait_histogram[STATS_HISTOGRAM_BUCKETS];
+  uint32_t byte_time_histogram[STATS_HISTOGRAM_BUCKETS];
+};
+
+// Counters of one port. Every counter is updated with a relaxed atomic add, so the tasks and the ISR of the port
+// never wait for each other. A snapshot is exact per counter but not across counters.
+class PS2StatsBlock {
+ public:
+  inline void add(uint32_t PS2Stats::*counter, uint32_t n = 1) { __atomic_fetch_add(&(_stats.*counter), n, __ATOMIC_RELAXED); }
+  inline void add_host_command(uint8_t opcode) {
+    uint32_t* counter = (opcode >= STATS_FIRST_HOST_COMMAND) ? &_stats.host_commands[opcode - STATS_FIRST_HOST_COMMAND] : &_stats.host_commands_other;
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+  }
+  inline void add_queue_wait(int64_t micros) { _add_to_histogram(_stats.queue_wait_histogram, micros); }
+  inline void add_byte_time(int64_t micros) { _add_to_histogram(_stats.byte_time_histogram, micros); }
+  // Copies the counters to `out`. With `reset`, each counter is cleared as it is read, so no count is lost.
+  void snapshot(PS2Stats* out, bool reset = false);
+  void reset();
+
+  static size_t histogram_bucket(int64_t micros);
+
+ protected:
+  inline void _add_to_histogram(uint32_t* histogram, int64_t micros) {
+    __atomic_fetch_add(&histogram[histogram_bucket(micros)], 1, __ATOMIC_RELAXED);
+  }
+
+  PS2Stats _stats = {};
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* FD1AA1AC_67BF_45B3_B641_FFE0CC5AF1BB */
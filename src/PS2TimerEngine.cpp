@@ -0,0 +1,216 @@
+#include "PS2TimerEngine.hpp"
+
+#include "Log.hpp"
+#include "PS2Gpio.hpp"
+
+namespace esp32_ps2dev {
+
+// Extra time allowed for a transmission on top of its length before giving up.
+const uint32_t TIMER_ENGINE_TIMEOUT_MARGIN_MILLIS = 10;
+
+PS2TimerEngine::PS2TimerEngine(uint8_t timer_num) : _own_hub(timer_num), _hub(&_own_hub) {}
+PS2TimerEngine::PS2TimerEngine(PS2Hub& hub) : _hub(&hub) {}
+
+int PS2TimerEngine::configure(uint32_t clk_half_period_micros, uint32_t byte_interval_micros) {
+  int ret = 0;
+  if (_hub == &_own_hub) {
+    _hub->configure(clk_half_period_micros);
+  } else if (_hub->get_clk_half_period_micros() != clk_half_period_micros) {
+    PS2DEV_LOGW("PS2TimerEngine::configure: clock period ignored, a shared hub runs the period set by PS2Hub::configure()");
+    ret = -1;
+  }
+  // the requested period is kept, so that transmit() reconfigures only when the request changes
+  _clk_half_period_micros = clk_half_period_micros;
+  _byte_interval_micros = byte_interval_micros;
+  _update_gap_ticks();
+  return ret;
+}
+
+uint32_t PS2TimerEngine::get_clk_half_period_micros() { return _hub->get_clk_half_period_micros(); }
+
+void PS2TimerEngine::_update_gap_ticks() {
+  const uint32_t tick_micros = _hub->get_tick_micros();
+  if (tick_micros > 0) _port.tx_gap_ticks = (_byte_interval_micros + tick_micros - 1) / tick_micros;
+}
+
+int PS2TimerEngine::begin(int clk, int data) {
+  _port.clk = clk;
+  _port.data = data;
+  ps2_gpio_init(clk);
+  ps2_gpio_init(data);
+  _port.rx_queue = xQueueCreateStatic(TIMER_ENGINE_RX_QUEUE_LENGTH, sizeof(uint16_t), _port.rx_queue_storage, &_port.rx_queue_buffer);
+  // the gap depends on the tick of the hub, which may have been configured after this engine
+  _update_gap_ticks();
+  return _hub->_attach(&_port);
+}
+
+int PS2TimerEngine::transmit(const uint8_t* data, size_t len, uint32_t clk_half_period_micros, uint32_t byte_interval_micros) {
+  if (_hub->_timer == nullptr) return -1;
+  if (len == 0) return 0;
+  if (clk_half_period_micros != _clk_half_period_micros || byte_interval_micros != _byte_interval_micros) {
+    configure(clk_half_period_micros, byte_interval_micros);
+  }
+
+  ulTaskNotifyTake(pdTRUE, 0);
+  // the timer of a shared hub may be stepping this port, it must not see a half-written request
+  taskENTER_CRITICAL(&_hub->_mux);
+  _port.tx_task = xTaskGetCurrentTaskHandle();
+  _port.tx_len = len;
+  _port.tx_index = 0;
+  _port.tx_gap_left = 0;
+  _port.tx_result = -1;
+  _port.tx_data = data;
+  taskEXIT_CRITICAL(&_hub->_mux);
+  _hub->_wake();
+
+  const uint32_t duration_micros = len * (22 * _hub->get_clk_half_period_micros() + byte_interval_micros);
+  if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(duration_micros / 1000 + TIMER_ENGINE_TIMEOUT_MARGIN_MILLIS)) == 0) {
+    // the host kept the bus, withdraw the request unless the ISR has already taken it
+    taskENTER_CRITICAL(&_hub->_mux);
+    const bool withdrawn = (_port.tx_data != nullptr && _port.state == PS2TimerPort::State::IDLE);
+    if (withdrawn) _port.tx_data = nullptr;
+    taskEXIT_CRITICAL(&_hub->_mux);
+    if (withdrawn) return (_port.tx_index > 0) ? -3 : -1;
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+  return _port.tx_result;
+}
+
+int PS2TimerEngine::receive(uint8_t* value, uint32_t timeout_ms) {
+  if (_port.rx_queue == nullptr) return -1;
+  uint16_t word;
+  if (xQueueReceive(_port.rx_queue, &word, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+    return -1;
+  }
+  *value = word & 0xFF;
+  return (word & 0x100) ? -2 : 0;
+}
+
+void PS2TimerEngine::set_rx_notify_task(TaskHandle_t task) { _port.rx_notify_task = task; }
+
+void IRAM_ATTR PS2TimerEngine::wake_from_isr() { _hub->_wake_from_isr(); }
+
+// Advances the port by a quarter period. Returns false when the port has nothing left to do.
+// Each bit takes four steps: set DATA, pull CLK low, hold, release CLK.
+bool IRAM_ATTR PS2TimerEngine::_step(PS2TimerPort& port, BaseType_t* woken) {
+  switch (port.state) {
+    case PS2TimerPort::State::IDLE: {
+      const bool clk_high = ps2_gpio_read(port.clk);
+      const bool data_high = ps2_gpio_read(port.data);
+      if (clk_high && !data_high) {
+        // host request to send has priority over our own bytes
+        if (port.tx_data != nullptr) _finish_tx(port, (port.tx_index > 0) ? -3 : -1, woken);
+        port.state = PS2TimerPort::State::RX;
+        port.bit = 0;
+        port.phase = 0;
+        port.frame = 0;
+        port.rx_parity = 1;
+        return true;
+      }
+      if (port.tx_data == nullptr) return false;
+      if (!clk_high) {
+        // communication inhibited, a packet already started is reported as interrupted
+        if (port.tx_index > 0) _finish_tx(port, -3, woken);
+        return true;
+      }
+      if (port.tx_gap_left > 0) {
+        port.tx_gap_left--;
+        return true;
+      }
+      port.frame = FRAME_TABLE[port.tx_data[port.tx_index]];
+      port.state = PS2TimerPort::State::TX;
+      port.bit = 0;
+      port.phase = 0;
+    }
+      // fall through
+    case PS2TimerPort::State::TX:
+      switch (port.phase) {
+        case 0:
+          if (port.frame & 0x01) {
+            ps2_gpio_release(port.data);
+          } else {
+            ps2_gpio_low(port.data);
+          }
+          break;
+        case 1:
+          if (!ps2_gpio_read(port.clk)) {
+            // the host pulled CLK low between bits, abort the frame and let the host talk
+            ps2_gpio_release(port.data);
+            port.state = PS2TimerPort::State::IDLE;
+            port.phase = 0;
+            _finish_tx(port, -3, woken);
+            return true;
+          }
+          ps2_gpio_low(port.clk);
+          break;
+        case 3:
+          ps2_gpio_release(port.clk);
+          port.frame = port.frame >> 1;
+          if (++port.bit == FRAME_BITS) {
+            port.state = PS2TimerPort::State::IDLE;
+            if (++port.tx_index == port.tx_len) {
+              _finish_tx(port, 0, woken);
+            } else {
+              port.tx_gap_left = port.tx_gap_ticks;
+            }
+          }
+          break;
+        default:
+          break;
+      }
+      port.phase = (port.phase + 1) & 0x03;
+      return true;
+    case PS2TimerPort::State::RX:
+      // same sequence as ps2_read_frame()
+      switch (port.phase) {
+        case 0:
+          if (port.bit >= 1 && port.bit <= 8) {
+            if (ps2_gpio_read(port.data)) {
+              port.frame |= 1 << (port.bit - 1);
+              port.rx_parity ^= 1;
+            }
+          } else if (port.bit == 9) {
+            // keep the received parity in bit 8 until the frame is done
+            if (ps2_gpio_read(port.data)) port.frame |= 0x100;
+          } else if (port.bit == FRAME_BITS - 1) {
+            ps2_gpio_low(port.data);
+          }
+          break;
+        case 1:
+          ps2_gpio_low(port.clk);
+          break;
+        case 3:
+          ps2_gpio_release(port.clk);
+          if (++port.bit == FRAME_BITS) {
+            port.state = PS2TimerPort::State::RX_ACK_RELEASE;
+          }
+          break;
+        default:
+          break;
+      }
+      port.phase = (port.phase + 1) & 0x03;
+      return true;
+    case PS2TimerPort::State::RX_ACK_RELEASE:
+      ps2_gpio_release(port.data);
+      _finish_rx(port, woken);
+      port.state = PS2TimerPort::State::IDLE;
+      return true;
+  }
+  return false;
+}
+
+void IRAM_ATTR PS2TimerEngine::_finish_tx(PS2TimerPort& port, int result, BaseType_t* woken) {
+  port.tx_result = result;
+  port.tx_data = nullptr;
+  if (port.tx_task != nullptr) vTaskNotifyGiveFromISR(port.tx_task, woken);
+}
+
+void IRAM_ATTR PS2TimerEngine::_finish_rx(PS2TimerPort& port, BaseType_t* woken) {
+  const uint8_t received_parity = (port.frame >> 8) & 0x01;
+  uint16_t word = port.frame & 0xFF;
+  if (received_parity != port.rx_parity) word |= 0x100;
+  xQueueSendFromISR(port.rx_queue, &word, woken);
+  if (port.rx_notify_task != nullptr) vTaskNotifyGiveFromISR(port.rx_notify_task, woken);
+}
+
+}  // namespace esp32_ps2dev
@@ -0,0 +1,89 @@
+#ifndef B68D50C1_6167_43C4_9661_38CBE60CE2D8
+#define B68D50C1_6167_43C4_9661_38CBE60CE2D8
+
+#include "Arduino.h"
+#include "PS2Frame.hpp"
+#include "PS2Hub.hpp"
+#include "PS2Transmitter.hpp"
+
+namespace esp32_ps2dev {
+
+const UBaseType_t TIMER_ENGINE_RX_QUEUE_LENGTH = 8;
+// A frame takes about 1.1 ms at the slowest clock. Callers waiting for a host byte allow this on top of their timeout.
+const uint32_t TIMER_ENGINE_FRAME_MILLIS = 2;
+
+// State of one port driven by PS2TimerEngine. Written by the timer ISR, read by tasks.
+struct PS2TimerPort {
+  enum class State : uint8_t { IDLE, TX, RX, RX_ACK_RELEASE };
+
+  int clk = -1;
+  int data = -1;
+  volatile State state = State::IDLE;
+  uint8_t bit = 0;
+  uint8_t phase = 0;
+  uint16_t frame = 0;
+  uint8_t rx_parity = 0;
+
+  // transmit request, set by a task and cleared by the ISR when done
+  const uint8_t* volatile tx_data = nullptr;
+  size_t tx_len = 0;
+  size_t tx_index = 0;
+  uint32_t tx_gap_ticks = 0;
+  uint32_t tx_gap_left = 0;
+  volatile int tx_result = 0;
+  TaskHandle_t tx_task = nullptr;
+
+  // received bytes, the parity error flag is stored in bit 8
+  QueueHandle_t rx_queue = nullptr;
+  StaticQueue_t rx_queue_buffer;
+  uint8_t rx_queue_storage[TIMER_ENGINE_RX_QUEUE_LENGTH * sizeof(uint16_t)];
+  TaskHandle_t rx_notify_task = nullptr;
+};
+
+// Non-blocking alternative to the bit-banging loops of PS2dev.
+// A hardware timer interrupts every quarter clock period and advances the frame state machine of the port
+// by one step, so a frame never holds the CPU or masks interrupts for longer than one step.
+// Tasks only exchange whole bytes with the ISR: transmit() sleeps until its bytes are sent,
+// and bytes sent by the host are queued for receive().
+// The timer is stopped while there is nothing to do and woken by transmit() or by wake_from_isr().
+// An engine either owns a timer, or is one port of a PS2Hub shared with other engines.
+class PS2TimerEngine : public PS2Transmitter {
+ public:
+  PS2TimerEngine(uint8_t timer_num = DEFAULT_TIMER_ENGINE_TIMER_NUM);
+  explicit PS2TimerEngine(PS2Hub& hub);
+  // Must be called before begin(), and only while no frame is in flight.
+  // The clock period of a port of a shared hub is set by PS2Hub::configure(). Returns 0 on success,
+  // -1 if the port is on a shared hub running another clock period, the byte interval is set anyway.
+  int configure(uint32_t clk_half_period_micros, uint32_t byte_interval_micros);
+  // Clock half period on the wire, which is the one of the hub.
+  uint32_t get_clk_half_period_micros();
+  int begin(int clk, int data);
+  // Returns 0 on success, -1 if the bus was not idle before the first byte,
+  // -3 if the host pulled CLK low in the middle of a frame or took over the bus between bytes.
+  int transmit(const uint8_t* data, size_t len, uint32_t clk_half_period_micros, uint32_t byte_interval_micros);
+  // Waits for a byte sent by the host. Returns 0 on success, -1 on timeout, -2 on parity error.
+  int receive(uint8_t* value, uint32_t timeout_ms);
+  // Task to notify when a byte from the host is queued.
+  void set_rx_notify_task(TaskHandle_t task);
+  // Starts the timer. Called from the host request interrupt so that host requests are noticed.
+  void wake_from_isr();
+  // True while a frame of the port is being clocked, in either direction.
+  inline bool IRAM_ATTR is_clocking() { return _port.state != PS2TimerPort::State::IDLE; }
+
+ protected:
+  void _update_gap_ticks();
+  static bool _step(PS2TimerPort& port, BaseType_t* woken);
+  static void _finish_tx(PS2TimerPort& port, int result, BaseType_t* woken);
+  static void _finish_rx(PS2TimerPort& port, BaseType_t* woken);
+  PS2Hub _own_hub;
+  PS2Hub* _hub;
+  uint32_t _clk_half_period_micros = 0;
+  uint32_t _byte_interval_micros = 0;
+  PS2TimerPort _port;
+
+  friend class PS2Hub;
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* B68D50C1_6167_43C4_9661_38CBE60CE2D8 */
@@ -0,0 +1,102 @@
+#include "PS2TimingCalibrator.hpp"
+
+#include <nvs.h>
+#include <stdio.h>
+
+namespace esp32_ps2dev {
+
+const size_t CALIBRATION_CLK_STEPS = sizeof(CALIBRATION_CLK_HALF_PERIODS_MICROS) / sizeof(CALIBRATION_CLK_HALF_PERIODS_MICROS[0]);
+const size_t CALIBRATION_BYTE_INTERVAL_STEPS = sizeof(CALIBRATION_BYTE_INTERVALS_MICROS) / sizeof(CALIBRATION_BYTE_INTERVALS_MICROS[0]);
+const char* const BUS_TIMING_NVS_NAMESPACE = "esp32_ps2dev";
+
+void PS2TimingCalibrator::start(uint16_t packets_per_step) {
+  _packets_per_step = (packets_per_step == 0) ? 1 : packets_per_step;
+  _packets_passed = 0;
+  _clk_index = 0;
+  _interval_index = CALIBRATION_BYTE_INTERVAL_STEPS - 1;
+  _phase = Phase::CLK;
+}
+
+void PS2TimingCalibrator::stop() { _phase = Phase::IDLE; }
+
+PS2BusTiming PS2TimingCalibrator::current() const {
+  return {CALIBRATION_CLK_HALF_PERIODS_MICROS[_clk_index], CALIBRATION_BYTE_INTERVALS_MICROS[_interval_index]};
+}
+
+bool PS2TimingCalibrator::on_packet_sent() {
+  if (!active()) return false;
+  if (++_packets_passed < _packets_per_step) return false;
+  return _next_phase();
+}
+
+bool PS2TimingCalibrator::on_host_error() {
+  if (!active()) return false;
+  _packets_passed = 0;
+  if (_phase == Phase::CLK) {
+    if (_clk_index + 1U < CALIBRATION_CLK_STEPS) {
+      _clk_index++;
+      return true;
+    }
+    // even the slowest clock failed, keep it and go on with the byte interval
+    return _next_phase();
+  }
+  if (_interval_index + 1U < CALIBRATION_BYTE_INTERVAL_STEPS) {
+    _interval_index++;
+    return true;
+  }
+  _phase = Phase::IDLE;
+  return false;
+}
+
+bool PS2TimingCalibrator::_next_phase() {
+  _packets_passed = 0;
+  if (_phase == Phase::CLK) {
+    _phase = Phase::BYTE_INTERVAL;
+    const bool changed = (_interval_index != 0);
+    _interval_index = 0;
+    return changed;
+  }
+  _phase = Phase::IDLE;
+  return false;
+}
+
+// NVS keys are limited to 15 characters.
+static void bus_timing_key(int clk, int data, char* key, size_t size) { snprintf(key, size, "timing%d_%d", clk, data); }
+
+int ps2_load_bus_timing(int clk, int data, PS2BusTiming* timing) {
+  char key[16];
+  bus_timing_key(clk, data, key, sizeof(key));
+  nvs_handle_t handle;
+  if (nvs_open(BUS_TIMING_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return -1;
+  PS2BusTiming stored;
+  size_t len = sizeof(stored);
+  const esp_err_t ret = nvs_get_blob(handle, key, &stored, &len);
+  nvs_close(handle);
+  if (ret != ESP_OK || len != sizeof(stored) || stored.clk_half_period_micros == 0) return -1;
+  *timing = stored;
+  return 0;
+}
+
+int ps2_save_bus_timing(int clk, int data, const PS2BusTiming& timing) {
+  char key[16];
+  bus_timing_key(clk, data, key, sizeof(key));
+  nvs_handle_t handle;
+  if (nvs_open(BUS_TIMING_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return -1;
+  esp_err_t ret = nvs_set_blob(handle, key, &timing, sizeof(timing));
+  if (ret == ESP_OK) ret = nvs_commit(handle);
+  nvs_close(handle);
+  return (ret == ESP_OK) ? 0 : -1;
+}
+
+int ps2_erase_bus_timing(int clk, int data) {
+  char key[16];
+  bus_timing_key(clk, data, key, sizeof(key));
+  nvs_handle_t handle;
+  if (nvs_open(BUS_TIMING_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return -1;
+  esp_err_t ret = nvs_erase_key(handle, key);
+  if (ret == ESP_OK) ret = nvs_commit(handle);
+  nvs_close(handle);
+  return (ret == ESP_OK) ? 0 : -1;
+}
+
+}  // namespace esp32_ps2dev
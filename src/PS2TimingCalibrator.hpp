@@ -0,0 +1,59 @@
+#ifndef EE9B1309_9400_4FAE_BA70_023E23EEDBB8
+#define EE9B1309_9400_4FAE_BA70_023E23EEDBB8
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace esp32_ps2dev {
+
+struct PS2BusTiming {
+  uint32_t clk_half_period_micros;
+  uint32_t byte_interval_micros;
+};
+
+// Candidates are tried from the fastest to the slowest. All clock periods are within the PS/2 specification
+// (10 to 16.7 kHz), so a host that drops bad frames silently instead of asking for a resend cannot make
+// calibration settle on a clock it does not support.
+const uint32_t CALIBRATION_CLK_HALF_PERIODS_MICROS[] = {30, 35, 40, 45, 50};
+const uint32_t CALIBRATION_BYTE_INTERVALS_MICROS[] = {25, 50, 100, 200};
+// Number of packets a candidate has to get through without the host asking for a resend.
+const uint16_t DEFAULT_CALIBRATION_PACKETS_PER_STEP = 64;
+
+// Finds the fastest bus timing the host accepts, from the traffic the device sends anyway.
+// The clock period is searched first with the longest byte interval, then the byte interval with the clock found.
+// A candidate fails when the host answers a packet with RESEND or RESET, and passes after enough packets without.
+// The search itself has no dependency on the Arduino core, PS2dev feeds it with events and applies current().
+class PS2TimingCalibrator {
+ public:
+  enum class Phase : uint8_t { IDLE, CLK, BYTE_INTERVAL };
+
+  void start(uint16_t packets_per_step = DEFAULT_CALIBRATION_PACKETS_PER_STEP);
+  void stop();
+  bool active() const { return _phase != Phase::IDLE; }
+  Phase phase() const { return _phase; }
+  // Timing to use while calibrating, and the result once finished.
+  PS2BusTiming current() const;
+
+  // Each returns true if current() has changed.
+  bool on_packet_sent();
+  bool on_host_error();
+
+ protected:
+  bool _next_phase();
+
+  Phase _phase = Phase::IDLE;
+  uint8_t _clk_index = 0;
+  uint8_t _interval_index = 0;
+  uint16_t _packets_per_step = DEFAULT_CALIBRATION_PACKETS_PER_STEP;
+  uint16_t _packets_passed = 0;
+};
+
+// Calibrated timings are stored in NVS, one entry per port identified by its pins.
+// Returns 0 on success, -1 if there is no stored timing or NVS is not available.
+int ps2_load_bus_timing(int clk, int data, PS2BusTiming* timing);
+int ps2_save_bus_timing(int clk, int data, const PS2BusTiming& timing);
+int ps2_erase_bus_timing(int clk, int data);
+
+}  // namespace esp32_ps2dev
+
+#endif /* EE9B1309_9400_4FAE_BA70_023E23EEDBB8 */
@@ -0,0 +1,53 @@
+#include "PS2Trace.hpp"
+
+#include <inttypes.h>
+
+namespace esp32_ps2dev {
+
+// The ring indexes entries with a mask, so only a power of two of them is used.
+static uint32_t ring_size(size_t capacity) {
+  uint32_t size = 1;
+  while (size * 2 <= capacity && size * 2 != 0) size *= 2;
+  return size;
+}
+
+int PS2Trace::begin(size_t capacity) {
+  if (capacity == 0) return -1;
+  const uint32_t size = ring_size(capacity);
+  return begin(new PS2TraceEntry[size], size);
+}
+
+int PS2Trace::begin(PS2TraceEntry* storage, size_t capacity) {
+  if (storage == nullptr || capacity == 0) return -1;
+  _mask = ring_size(capacity) - 1;
+  _recorded = 0;
+  _storage = storage;
+  return 0;
+}
+
+size_t PS2Trace::dump(PS2TraceEntry* out, size_t max_entries) {
+  if (_storage == nullptr) return 0;
+  const uint32_t recorded = __atomic_load_n(&_recorded, __ATOMIC_RELAXED);
+  size_t count = (recorded > _mask) ? _mask + 1 : recorded;
+  if (count > max_entries) count = max_entries;
+  for (size_t i = 0; i < count; i++) {
+    out[i] = _storage[(recorded - count + i) & _mask];
+  }
+  return count;
+}
+
+void PS2Trace::print(Print& out) {
+  static const char* const EVENT_NAMES[] = {"D>H", "H>D", "INH", "RTS"};
+  if (_storage == nullptr) return;
+  const uint32_t recorded = __atomic_load_n(&_recorded, __ATOMIC_RELAXED);
+  const size_t count = (recorded > _mask) ? _mask + 1 : recorded;
+  for (size_t i = 0; i < count; i++) {
+    const PS2TraceEntry entry = _storage[(recorded - count + i) & _mask];
+    out.printf("%10" PRIu32 " %s %02X %d\n", entry.timestamp_micros, EVENT_NAMES[(uint8_t)entry.event & 0x03], entry.value, entry.result);
+  }
+}
+
+void PS2Trace::clear() { __atomic_store_n(&_recorded, 0, __ATOMIC_RELAXED); }
+uint32_t PS2Trace::recorded() { return __atomic_load_n(&_recorded, __ATOMIC_RELAXED); }
+
+}  // namespace esp32_ps2dev
@@ -0,0 +1,57 @@
+#ifndef B7B00118_CE3C_47F2_A90F_EEE5704BA9D3
+#define B7B00118_CE3C_47F2_A90F_EEE5704BA9D3
+
+#include <esp_timer.h>
+
+#include "Arduino.h"
+
+namespace esp32_ps2dev {
+
+enum class PS2TraceEvent : uint8_t {
+  DEVICE_TO_HOST,        // a byte sent by the device
+  HOST_TO_DEVICE,        // a byte received from the host
+  INHIBIT,               // the host held CLK low while the device wanted to send
+  HOST_REQUEST_TO_SEND,  // the host released CLK with DATA low
+};
+
+struct PS2TraceEntry {
+  uint32_t timestamp_micros;  // lower 32 bits of esp_timer_get_time()
+  PS2TraceEvent event;
+  uint8_t value;
+  // 0 on success, -1 if the bus was not idle, -2 on parity error, -3 if the host interrupted the frame
+  int8_t result;
+  uint8_t reserved;
+};
+
+// Fixed-size ring of the latest frames and bus events of a port.
+// Recording is one atomic increment and an 8-byte store, with no lock, so it is safe from tasks and ISRs alike.
+// An entry being written while dump() copies it may appear half written.
+class PS2Trace {
+ public:
+  // The capacity is rounded down to a power of two, and begin(capacity) allocates only that many entries.
+  // Returns 0 on success, -1 on invalid arguments.
+  int begin(size_t capacity);
+  int begin(PS2TraceEntry* storage, size_t capacity);
+
+  inline void IRAM_ATTR record(PS2TraceEvent event, uint8_t value = 0, int8_t result = 0) {
+    if (_storage == nullptr) return;
+    const uint32_t index = __atomic_fetch_add(&_recorded, 1, __ATOMIC_RELAXED) & _mask;
+    _storage[index] = {(uint32_t)esp_timer_get_time(), event, value, result, 0};
+  }
+  // Copies the entries from the oldest to the newest. Returns the number of entries copied.
+  size_t dump(PS2TraceEntry* out, size_t max_entries);
+  // Prints the entries from the oldest to the newest, one per line.
+  void print(Print& out);
+  void clear();
+  // Number of entries recorded since begin() or clear(), including those overwritten.
+  uint32_t recorded();
+
+ protected:
+  PS2TraceEntry* _storage = nullptr;
+  uint32_t _mask = 0;
+  uint32_t _recorded = 0;
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* B7B00118_CE3C_47F2_A90F_EEE5704BA9D3 */
@@ -0,0 +1,25 @@
+#ifndef A71B5DD4_8E81_4D74_B98E_75D929DE2EDD
+#define A71B5DD4_8E81_4D74_B98E_75D929DE2EDD
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace esp32_ps2dev {
+
+// Backend which clocks out whole packets from device to host.
+// PS2dev uses it for packets taken from the packet queue, single bytes such as ACK are still sent by PS2dev::write().
+// Implementations do not depend on the Arduino core, so a host-side mock can implement this interface as well.
+class PS2Transmitter {
+ public:
+  virtual ~PS2Transmitter() {}
+  // Called from PS2dev::begin(). Returns 0 on success.
+  virtual int begin(int clk, int data) = 0;
+  // Sends `len` bytes as consecutive frames separated by `byte_interval_micros`.
+  // Blocks the calling task until the last frame is on the wire.
+  // Returns 0 on success, -1 if nothing was sent because the bus was busy, -3 if the transmission failed after it started.
+  virtual int transmit(const uint8_t* data, size_t len, uint32_t clk_half_period_micros, uint32_t byte_interval_micros) = 0;
+};
+
+}  // namespace esp32_ps2dev
+
+#endif /* A71B5DD4_8E81_4D74_B98E_75D929DE2EDD */
@@ -0,0 +1,20 @@
+#ifndef C699CF62_5A76_4980_B4E8_020EA27D64D5
+#define C699CF62_5A76_4980_B4E8_020EA27D64D5
+
+#include <stdint.h>
+
+#include "esp_attr.h"
+
+#define LOW 0
+#define HIGH 1
+
+// A single thread runs the tests, critical sections have nothing to exclude.
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define taskENTER_CRITICAL(mux) ((void)(mux))
+#define taskEXIT_CRITICAL(mux) ((void)(mux))
+
+// Defined by the test, which simulates the time.
+uint32_t getCpuFrequencyMhz();
+
+#endif /* C699CF62_5A76_4980_B4E8_020EA27D64D5 */
@@ -0,0 +1,14 @@
+#ifndef BDF0DB4E_A655_4843_92B3_058DCFA0C034
+#define BDF0DB4E_A655_4843_92B3_058DCFA0C034
+
+#include <stdint.h>
+
+typedef int gpio_num_t;
+typedef enum { GPIO_MODE_INPUT_OUTPUT_OD } gpio_mode_t;
+
+inline int gpio_reset_pin(gpio_num_t) { return 0; }
+inline int gpio_pullup_dis(gpio_num_t) { return 0; }
+inline int gpio_set_level(gpio_num_t, uint32_t) { return 0; }
+inline int gpio_set_direction(gpio_num_t, gpio_mode_t) { return 0; }
+
+#endif /* BDF0DB4E_A655_4843_92B3_058DCFA0C034 */
@@ -0,0 +1,7 @@
+#ifndef CA4A5DC3_5B18_40AF_AFC1_2E146473775A
+#define CA4A5DC3_5B18_40AF_AFC1_2E146473775A
+
+// The parts of ESP-IDF and the Arduino core the sources under test use, so they build with plain g++.
+#define IRAM_ATTR
+
+#endif /* CA4A5DC3_5B18_40AF_AFC1_2E146473775A */
@@ -0,0 +1,9 @@
+#ifndef B6550C09_D51B_4A6A_8319_6882E245A834
+#define B6550C09_D51B_4A6A_8319_6882E245A834
+
+#include <stdint.h>
+
+// Defined by the test, which simulates the time.
+uint32_t cpu_hal_get_cycle_count();
+
+#endif /* B6550C09_D51B_4A6A_8319_6882E245A834 */
@@ -0,0 +1,20 @@
+#ifndef F582FF6F_FDB1_4FB5_8985_A36C8076CC64
+#define F582FF6F_FDB1_4FB5_8985_A36C8076CC64
+
+#include <stdint.h>
+
+// The tests drive the lines through mock pins, these registers are never touched.
+struct gpio_reg_t {
+  uint32_t val;
+};
+struct gpio_dev_t {
+  uint32_t out_w1ts;
+  uint32_t out_w1tc;
+  gpio_reg_t out1_w1ts;
+  gpio_reg_t out1_w1tc;
+  uint32_t in;
+  gpio_reg_t in1;
+};
+static gpio_dev_t GPIO;
+
+#endif /* F582FF6F_FDB1_4FB5_8985_A36C8076CC64 */
@@ -0,0 +1,6 @@
+#ifndef DFFE1A96_9FC2_4CA7_A3EF_BD21ED1B028A
+#define DFFE1A96_9FC2_4CA7_A3EF_BD21ED1B028A
+
+#define SOC_GPIO_PIN_COUNT 40
+
+#endif /* DFFE1A96_9FC2_4CA7_A3EF_BD21ED1B028A */
@@ -0,0 +1,32 @@
+#ifndef C78EB3E8_92DF_4906_9D8B_7897A7F31806
+#define C78EB3E8_92DF_4906_9D8B_7897A7F31806
+
+#include <stdio.h>
+
+// Minimal checks for the host-side tests, which build with plain g++ and no test framework.
+static int test_failures = 0;
+
+#define CHECK(cond)                                                \
+  do {                                                             \
+    if (!(cond)) {                                                 \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+      test_failures++;                                             \
+    }                                                              \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                                    \
+  do {                                                                                                                \
+    const long long _a = (long long)(actual), _e = (long long)(expected);                                            \
+    if (_a != _e) {                                                                                                   \
+      printf("%s:%d: CHECK_EQ failed: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _a, _e);            \
+      test_failures++;                                                                                                \
+    }                                                                                                                 \
+  } while (0)
+
+// Prints the result and returns the exit status of the test program.
+static int test_report(const char* name) {
+  printf("%s: %s\n", name, test_failures == 0 ? "OK" : "FAILED");
+  return test_failures == 0 ? 0 : 1;
+}
+
+#endif /* C78EB3E8_92DF_4906_9D8B_7897A7F31806 */
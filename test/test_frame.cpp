@@ -0,0 +1,137 @@
+// Checks frame encoding through a mock PS2Transmitter, which renders packets with PS2FrameEncoder
+// like the RMT backend does and decodes the symbol streams back by sampling DATA on the falling edges of CLK.
+#include <vector>
+
+#include "PS2Frame.hpp"
+#include "PS2Transmitter.hpp"
+#include "test.hpp"
+
+using namespace esp32_ps2dev;
+
+class MockTransmitter : public PS2Transmitter {
+ public:
+  int begin(int clk, int data) override { return 0; }
+  int transmit(const uint8_t* data, size_t len, uint32_t clk_half_period_micros, uint32_t byte_interval_micros) override {
+    PS2FrameEncoder encoder(clk_half_period_micros, byte_interval_micros);
+    clk.resize(PS2FrameEncoder::max_symbols(len));
+    this->data.resize(PS2FrameEncoder::max_symbols(len));
+    clk.resize(encoder.encode_clk(len, clk.data(), clk.size()));
+    this->data.resize(encoder.encode_data(data, len, this->data.data(), this->data.size()));
+    return (clk.empty() || this->data.empty()) ? -3 : 0;
+  }
+
+  std::vector<PS2Symbol> clk;
+  std::vector<PS2Symbol> data;
+};
+
+static uint32_t total_micros(const std::vector<PS2Symbol>& symbols) {
+  uint32_t total = 0;
+  for (const PS2Symbol& symbol : symbols) total += symbol.duration_micros;
+  return total;
+}
+
+static std::vector<uint32_t> falling_edges(const std::vector<PS2Symbol>& symbols) {
+  std::vector<uint32_t> edges;
+  uint32_t t = 0;
+  for (size_t i = 0; i < symbols.size(); i++) {
+    if (i > 0 && symbols[i - 1].level == 1 && symbols[i].level == 0) edges.push_back(t);
+    t += symbols[i].duration_micros;
+  }
+  return edges;
+}
+
+static uint8_t level_at(const std::vector<PS2Symbol>& symbols, uint32_t at_micros) {
+  uint32_t t = 0;
+  for (const PS2Symbol& symbol : symbols) {
+    if (at_micros < t + symbol.duration_micros) return symbol.level;
+    t += symbol.duration_micros;
+  }
+  return 1;
+}
+
+// Sends one byte and returns the 11 bits the host samples, bit 0 first.
+static std::vector<uint8_t> sample_frame(PS2Transmitter& transmitter, MockTransmitter& mock, uint8_t value) {
+  std::vector<uint8_t> bits;
+  CHECK_EQ(transmitter.transmit(&value, 1, 40, 100), 0);
+  for (uint32_t edge : falling_edges(mock.clk)) bits.push_back(level_at(mock.data, edge));
+  return bits;
+}
+
+static void test_frame_table() {
+  for (int value = 0; value < 256; value++) {
+    const uint16_t frame = FRAME_TABLE[value];
+    CHECK_EQ(frame & 0x01, 0);
+    CHECK_EQ((frame >> 1) & 0xFF, value);
+    CHECK_EQ(__builtin_popcount((frame >> 1) & 0x1FF) % 2, 1);
+    CHECK_EQ(frame >> 10, 1);
+    CHECK_EQ(encode_frame(value), frame);
+  }
+}
+
+static void test_bits(uint8_t value) {
+  MockTransmitter mock;
+  std::vector<uint8_t> bits = sample_frame(mock, mock, value);
+  CHECK_EQ(bits.size(), FRAME_BITS);
+  if (bits.size() != FRAME_BITS) return;
+  CHECK_EQ(bits[0], 0);
+  int ones = 0;
+  for (int i = 0; i < 8; i++) {
+    CHECK_EQ(bits[1 + i], (value >> i) & 0x01);
+    ones += bits[1 + i];
+  }
+  CHECK_EQ((ones + bits[9]) % 2, 1);
+  CHECK_EQ(bits[10], 1);
+}
+
+static void test_timing(uint32_t half) {
+  const uint32_t quarter = half / 2;
+  const uint32_t interval = 100;
+  const uint8_t packet[2] = {0xAA, 0x55};
+  MockTransmitter mock;
+  PS2Transmitter& transmitter = mock;
+  CHECK_EQ(transmitter.transmit(packet, sizeof(packet), half, interval), 0);
+
+  // both lines start together and have the same length
+  CHECK_EQ(total_micros(mock.clk), total_micros(mock.data));
+  CHECK_EQ(mock.clk[0].level, 1);
+  CHECK_EQ(mock.clk[0].duration_micros, quarter);
+  for (const PS2Symbol& symbol : mock.clk) {
+    if (symbol.level == 0) CHECK_EQ(symbol.duration_micros, half);
+  }
+
+  std::vector<uint32_t> edges = falling_edges(mock.clk);
+  CHECK_EQ(edges.size(), 2 * FRAME_BITS);
+  if (edges.size() != 2 * FRAME_BITS) return;
+  for (size_t i = 1; i < edges.size(); i++) {
+    if (i == FRAME_BITS) {
+      // low half, quarter after the stop bit, byte interval, quarter before the next start bit
+      CHECK_EQ(edges[i] - edges[i - 1], half + quarter + interval + quarter);
+    } else {
+      CHECK_EQ(edges[i] - edges[i - 1], 2 * half);
+    }
+  }
+  // DATA settles a quarter period before each falling edge and holds until a quarter period after it
+  for (uint32_t edge : edges) {
+    CHECK_EQ(level_at(mock.data, edge - quarter), level_at(mock.data, edge));
+    CHECK_EQ(level_at(mock.data, edge + quarter - 1), level_at(mock.data, edge));
+  }
+}
+
+static void test_too_few_symbols() {
+  const uint8_t value = 0xAA;
+  PS2Symbol symbols[4];
+  PS2FrameEncoder encoder(40, 100);
+  CHECK_EQ(encoder.encode_clk(1, symbols, 4), 0);
+  CHECK_EQ(encoder.encode_data(&value, 1, symbols, 4), 0);
+}
+
+int main() {
+  test_frame_table();
+  test_bits(0x00);
+  test_bits(0xFF);
+  test_bits(0xAA);
+  test_timing(40);
+  test_timing(35);
+  test_too_few_symbols();
+  return test_report("test_frame");
+}
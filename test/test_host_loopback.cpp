@@ -0,0 +1,182 @@
+// Connects the host side, PS2HostFramer, to the device side, the frame loops of PS2dev, back to back
+// through a simulated open-drain bus, and checks a reset, a command and a report going through.
+//
+// Time is simulated: every read of the cycle counter advances it by one cycle, at 1 MHz, so the busy-wait
+// loops of PS2Timing run the bus forward. A falling edge of CLK calls the host as its interrupt would.
+#include <vector>
+
+#include "PS2BitBang.hpp"
+#include "PS2HostFramer.hpp"
+#include "test.hpp"
+
+using namespace esp32_ps2dev;
+
+static uint32_t sim_cycles = 0;
+uint32_t getCpuFrequencyMhz() { return 1; }
+uint32_t cpu_hal_get_cycle_count() { return ++sim_cycles; }
+static void sim_wait(uint32_t micros) { sim_cycles += micros; }
+
+// Each side can only pull a line low, the line is high unless one of them does.
+struct Line {
+  bool host_low = false;
+  bool device_low = false;
+  int level() const { return (host_low || device_low) ? LOW : HIGH; }
+};
+static Line clk_line;
+static Line data_line;
+
+static void on_clk_falling();
+
+static void drive_clk(bool& side_low, bool low) {
+  const int before = clk_line.level();
+  side_low = low;
+  if (before == HIGH && clk_line.level() == LOW) on_clk_falling();
+}
+
+class HostPins {
+ public:
+  void clk_low() { drive_clk(clk_line.host_low, true); }
+  void clk_release() { drive_clk(clk_line.host_low, false); }
+  int clk_read() { return clk_line.level(); }
+  void data_low() { data_line.host_low = true; }
+  void data_release() { data_line.host_low = false; }
+  int data_read() { return data_line.level(); }
+};
+
+class DevicePins {
+ public:
+  void clk_low() { drive_clk(clk_line.device_low, true); }
+  void clk_release() { drive_clk(clk_line.device_low, false); }
+  int clk_read() { return clk_line.level(); }
+  void data_low() { data_line.device_low = true; }
+  void data_release() { data_line.device_low = false; }
+  int data_read() { return data_line.level(); }
+};
+
+// Host side, as PS2Host runs it from its interrupt: received frames and send results are collected here.
+static PS2HostFramer<HostPins> host{HostPins()};
+static std::vector<uint16_t> host_received;
+static int host_sent = 0;
+
+static void on_clk_falling() {
+  switch (host.on_clk_falling(sim_cycles)) {
+    case PS2HostFramer<HostPins>::Event::RECEIVED:
+      host_received.push_back(host.received());
+      break;
+    case PS2HostFramer<HostPins>::Event::SENT:
+      host_sent++;
+      break;
+    default:
+      break;
+  }
+}
+
+// Device side, as PS2dev clocks its frames, with its default timing.
+const uint32_t CLK_HALF_PERIOD_MICROS = 30;
+const uint32_t BYTE_INTERVAL_MICROS = 100;
+static DevicePins device_pins;
+static portMUX_TYPE device_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static int device_write(uint8_t value) {
+  sim_wait(BYTE_INTERVAL_MICROS);
+  PS2Timing timing(CLK_HALF_PERIOD_MICROS);
+  PS2CriticalSection cs(&device_mux, MASKED_MICROS_UNBOUNDED);
+  return ps2_write_frame(device_pins, FRAME_TABLE[value], timing, cs);
+}
+
+// Returns -1 unless the host is requesting to send, like PS2dev::read().
+static int device_read(uint8_t* value) {
+  if (device_pins.clk_read() == LOW || device_pins.data_read() == HIGH) return -1;
+  PS2Timing timing(CLK_HALF_PERIOD_MICROS);
+  PS2CriticalSection cs(&device_mux, MASKED_MICROS_UNBOUNDED);
+  return ps2_read_frame(device_pins, value, timing, cs);
+}
+
+// Answers one host command like a mouse does. Returns the command, or -1 if none was clocked in.
+static int device_answer_command() {
+  uint8_t cmd;
+  if (device_read(&cmd) != 0) return -1;
+  device_write(0xFA);
+  if (cmd == 0xFF) {
+    device_write(0xAA);
+    device_write(0x00);
+  } else if (cmd == 0xF2) {
+    device_write(0x00);
+  }
+  return cmd;
+}
+
+// Sends a command like PS2Host::write(), while the device clocks it in and answers.
+static int host_command(uint8_t cmd) {
+  host_received.clear();
+  host_sent = 0;
+  host.inhibit();
+  sim_wait(HOST_INHIBIT_BEFORE_SEND_MICROS);
+  host.start_send(cmd);
+  return device_answer_command();
+}
+
+static void check_received(const std::vector<uint8_t>& expected) {
+  CHECK_EQ(host_received.size(), expected.size());
+  for (size_t i = 0; i < host_received.size() && i < expected.size(); i++) {
+    CHECK_EQ(host_received[i], expected[i]);
+  }
+}
+
+static void test_reset() {
+  CHECK_EQ(host_command(0xFF), 0xFF);
+  CHECK_EQ(host_sent, 1);
+  CHECK_EQ(host.sent_result(), 0);
+  // ACK, BAT passed, device id
+  check_received({0xFA, 0xAA, 0x00});
+  CHECK_EQ(clk_line.level(), HIGH);
+  CHECK_EQ(data_line.level(), HIGH);
+}
+
+static void test_command() {
+  CHECK_EQ(host_command(0xF2), 0xF2);
+  CHECK_EQ(host.sent_result(), 0);
+  check_received({0xFA, 0x00});
+  CHECK_EQ(host_command(0xF4), 0xF4);
+  CHECK_EQ(host.sent_result(), 0);
+  check_received({0xFA});
+}
+
+static void test_mouse_report() {
+  const uint8_t report[3] = {0x29, 0x05, 0xFB};
+  host_received.clear();
+  for (uint8_t value : report) CHECK_EQ(device_write(value), 0);
+  check_received({0x29, 0x05, 0xFB});
+}
+
+static void test_inhibited() {
+  host_received.clear();
+  host.inhibit();
+  CHECK_EQ(device_write(0x08), -3);
+  host.release();
+  CHECK(host_received.empty());
+  CHECK_EQ(data_line.level(), HIGH);
+}
+
+static void test_not_acknowledged() {
+  // nobody clocks the request in, the host gives up
+  host_sent = 0;
+  host.inhibit();
+  sim_wait(HOST_INHIBIT_BEFORE_SEND_MICROS);
+  host.start_send(0xF4);
+  CHECK_EQ(host.sent_result(), -1);
+  host.abort_send();
+  CHECK_EQ(host_sent, 0);
+  CHECK_EQ(data_line.level(), HIGH);
+}
+
+int main() {
+  test_reset();
+  test_command();
+  test_mouse_report();
+  test_inhibited();
+  test_not_acknowledged();
+  // the bus still works after the aborted request
+  test_command();
+  return test_report("test_host_loopback");
+}